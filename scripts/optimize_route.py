@@ -12,8 +12,6 @@ import sys
 import tempfile
 import time
 
-from collections import deque
-
 #------------------------------------------------------------------------------
 # Constants
 #------------------------------------------------------------------------------
@@ -32,38 +30,40 @@ def format_log_entry(msg):
     return f'[{datetime.datetime.now()}] {msg}'
 
 
+def run_benchmark(first_seed, last_seed, jobs, output_dir):
+    cmd_args = ['build/rosa', '-r', 'paladin', '-s', f'{first_seed}-{last_seed}', '-m', '64', '--jobs', str(jobs), '--output-dir', output_dir]
+    process = subprocess.run(cmd_args, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE)
+    times = {}
+
+    for line in process.stderr.decode('utf-8').split('\n'):
+        matches = re.match('Seed ([0-9]+): ([0-9.]+)s', line)
+
+        if matches:
+            times[int(matches.group(1))] = float(matches.group(2))
+
+    return times
+
+
 def generate_timings(max_threads):
     print('Generating timings...')
 
-    cmd_args = ['/usr/bin/time', '-f', 'BENCHMARK %e', 'build/rosa', '-r', 'paladin', '-s', '0', '-m', '64']
     timings = []
-    base_time = None
-
-    for i in range(max_threads):
-        suffix = '' if i == 0 else 's'
-        print(f'Testing {i+1} simultaneous thread{suffix}...', end='')
-        sys.stdout.flush()
-        processes = deque()
-        for _ in range(i + 1):
-            processes.append(subprocess.Popen(cmd_args, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE))
 
-        samples = []
+    with tempfile.TemporaryDirectory() as output_dir:
+        base_times = {}
 
-        while len(processes) > 0:
-            process = processes.popleft()
-            _, err = process.communicate()
-            err = err.decode('utf-8')
-            for line in err.split('\n'):
-                if line.startswith('BENCHMARK'):
-                    t = float(line.strip().split(' ')[1])
-                    samples.append(t)
+        for seed in range(max_threads):
+            base_times.update(run_benchmark(seed, seed, 1, output_dir))
 
-        if i == 0:
-            base_time = samples[0]
+        for i in range(max_threads):
+            suffix = '' if i == 0 else 's'
+            print(f'Testing {i+1} simultaneous thread{suffix}...', end='')
+            sys.stdout.flush()
 
-        timings.append(statistics.mean(samples) / base_time)
+            times = run_benchmark(0, i, i + 1, output_dir)
+            timings.append(statistics.mean(t / base_times[seed] for seed, t in times.items()))
 
-        print(f' {statistics.mean(samples):0.3f}s, {timings[i]:0.3f}x')
+            print(f' {statistics.mean(times.values()):0.3f}s, {timings[i]:0.3f}x')
 
     return timings
 
@@ -0,0 +1,57 @@
+#!/usr/bin/env python3
+
+import argparse
+import subprocess
+import sys
+
+
+#------------------------------------------------------------------------------
+# Constants
+#------------------------------------------------------------------------------
+
+# Each case is optimized by both engines, which must generate the same route.
+# The test route forces the frontier engine to step past the maximum value of a
+# variable until a search can complete, which is where the expansion and
+# resolution passes must agree on the values they try.
+CASES = [
+    ['-r', 'tests/search-past-maximum', '-s', '0', '-m', '0'],
+    ['-r', 'tests/search-past-maximum', '-s', '3', '-m', '0'],
+    ['-r', 'tests/search-past-maximum', '-s', '7', '-m', '2'],
+    ['-r', 'paladin', '-s', '5', '-m', '4'],
+]
+
+
+#------------------------------------------------------------------------------
+# Main Execution
+#------------------------------------------------------------------------------
+
+def main():
+    parser = argparse.ArgumentParser(description='Checks that both optimization engines generate the same routes')
+    parser.add_argument('rosa', metavar='ROSA', type=str, help='path to the rosa executable')
+    args = parser.parse_args()
+
+    failed = False
+
+    for case in CASES:
+        outputs = {}
+
+        for engine in ['recursive', 'frontier']:
+            process = subprocess.run([args.rosa, *case, '-e', engine], stdout=subprocess.PIPE, stderr=subprocess.PIPE, universal_newlines=True)
+
+            if process.returncode != 0 or 'BUG:' in process.stderr:
+                print(f'FAIL: {" ".join(case)} with the {engine} engine:\n{process.stderr}')
+                failed = True
+
+            outputs[engine] = process.stdout
+
+        if outputs['recursive'] != outputs['frontier']:
+            print(f'FAIL: {" ".join(case)} generates different routes with each engine')
+            failed = True
+        else:
+            print(f'OK: {" ".join(case)}')
+
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == '__main__':
+    main()
@@ -2,72 +2,245 @@
 
 #include "state.hh"
 
+#include <boost/algorithm/string/join.hpp>
 #include <boost/format.hpp>
 
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
 #include <filesystem>
 #include <iostream>
+#include <limits>
+#include <system_error>
+
+using namespace std::chrono_literals;
+
+constexpr std::size_t WRITE_QUEUE_SIZE = 262144;
+constexpr std::size_t MAXIMUM_WRITE_BATCH_SIZE = 65536;
+constexpr auto WRITE_INTERVAL = 1ms;
+
+// Every state key is 16 bytes, so this key can never collide with one.
+constexpr std::string_view METADATA_KEY{"metadata"};
+
+constexpr std::array<char, 8> MAPPED_CACHE_MAGIC{'R', 'O', 'S', 'A', 'M', 'A', 'P', '\0'};
+constexpr uint32_t MAPPED_CACHE_VERSION = 2;
+constexpr uint64_t MAPPED_CACHE_INITIAL_CAPACITY = 1048576;
+constexpr uint64_t MAPPED_CACHE_LOAD_NUMERATOR = 3;
+constexpr uint64_t MAPPED_CACHE_LOAD_DENOMINATOR = 4;
 
-const std::size_t MAX_QUEUE_SIZE = 1024;
+// Marks a slot of a shared cache whose keys are still being written. The low
+// half would be a stored value of -2, which can never occur.
+constexpr uint64_t MAPPED_CACHE_BUSY = std::numeric_limits<uint64_t>::max();
 
 Cache::~Cache() = default;
 
-auto DynamicCache::get(const State & state) -> std::pair<int, Milliframes> {
-	auto keys{state.get_keys()};
+void Cache::prefetch([[maybe_unused]] const State & state) const { }
 
-	if (_cache.count(keys) == 0) {
-		return std::make_pair(-1, Milliframes::max());
+// Caches stored on disk already outlive a run, so only the in-memory caches
+// expose their entries for checkpoints.
+void Cache::get_entries([[maybe_unused]] std::vector<CacheTable::Entry> * entries) const { }
+
+void Cache::insert([[maybe_unused]] const std::vector<CacheTable::Entry> & entries) { }
+
+auto DiskCache::_get_metadata_error(const std::string & filename, const std::optional<CacheMetadata> & stored, const CacheMetadata & expected) -> std::string {
+	if (!stored) {
+		return "The cache at " + filename + " was created by an earlier version of Rosa and cannot be checked. Delete it or use a different cache location.";
+	}
+
+	auto differences{stored->get_differences(expected)};
+
+	if (differences.empty()) {
+		return "";
 	}
 
-	return _cache.at(keys);
+	return "The cache at " + filename + " does not match this run: " + boost::algorithm::join(differences, ", ") + ". Delete it or use a different cache location.";
+}
+
+DynamicCache::DynamicCache(std::size_t memory_limit) : _cache{memory_limit} { }
+
+auto DynamicCache::get(const State & state) -> std::pair<int, Milliframes> {
+	return _cache.get(state.get_keys());
 }
 
 void DynamicCache::set(const State & state, int value, Milliframes frames) {
-	_cache[state.get_keys()] = std::make_pair(value, frames);
+	_cache.set(state.get_keys(), value, frames);
+}
+
+void DynamicCache::prefetch(const State & state) const {
+	_cache.prefetch(state.get_keys());
+}
+
+void DynamicCache::get_entries(std::vector<CacheTable::Entry> * entries) const {
+	_cache.get_entries(entries);
+}
+
+void DynamicCache::insert(const std::vector<CacheTable::Entry> & entries) {
+	for (const auto & entry : entries) {
+		_cache.insert(entry);
+	}
 }
 
 auto DynamicCache::get_size() const -> std::size_t {
-	return _cache.size();
+	return _cache.get_size();
+}
+
+auto DynamicCache::get_statistics() const -> CacheStatistics {
+	return _cache.get_statistics();
+}
+
+ConcurrentCache::ConcurrentCache(std::size_t shards, std::size_t memory_limit) {
+	shards = std::max(shards, static_cast<std::size_t>(1));
+
+	for (std::size_t i = 0; i < shards; i++) {
+		_shards.push_back(std::make_unique<Shard>(memory_limit / shards));
+	}
+}
+
+auto ConcurrentCache::get(const State & state) -> std::pair<int, Milliframes> {
+	auto keys{state.get_keys()};
+	auto & shard{_get_shard(keys)};
+	std::lock_guard<std::mutex> lock{shard.mutex};
+
+	return shard.cache.get(keys);
 }
 
-PersistentCache::PersistentCache(const std::string & filename, std::size_t cache_size) : _cache_size{cache_size}, _env{lmdb::env::create()} {
+void ConcurrentCache::set(const State & state, int value, Milliframes frames) {
+	auto keys{state.get_keys()};
+	auto & shard{_get_shard(keys)};
+	std::lock_guard<std::mutex> lock{shard.mutex};
+
+	shard.cache.set(keys, value, frames);
+}
+
+/*
+ * Copies each shard in turn, so other threads are only held up by the shard
+ * being copied. The copy is not a single snapshot of the whole cache, but
+ * every entry is a solved state on its own, so any mix of them is valid.
+ */
+void ConcurrentCache::get_entries(std::vector<CacheTable::Entry> * entries) const {
+	for (const auto & shard : _shards) {
+		std::lock_guard<std::mutex> lock{shard->mutex};
+		shard->cache.get_entries(entries);
+	}
+}
+
+void ConcurrentCache::insert(const std::vector<CacheTable::Entry> & entries) {
+	for (const auto & entry : entries) {
+		auto & shard{_get_shard(std::make_pair(entry.key1, entry.key2))};
+		std::lock_guard<std::mutex> lock{shard.mutex};
+
+		shard.cache.insert(entry);
+	}
+}
+
+auto ConcurrentCache::get_size() const -> std::size_t {
+	std::size_t size{0};
+
+	for (const auto & shard : _shards) {
+		std::lock_guard<std::mutex> lock{shard->mutex};
+		size += shard->cache.get_size();
+	}
+
+	return size;
+}
+
+auto ConcurrentCache::get_statistics() const -> CacheStatistics {
+	CacheStatistics statistics;
+
+	for (const auto & shard : _shards) {
+		std::lock_guard<std::mutex> lock{shard->mutex};
+		statistics += shard->cache.get_statistics();
+	}
+
+	return statistics;
+}
+
+auto ConcurrentCache::_get_shard(const std::pair<uint64_t, uint64_t> & keys) const -> Shard & {
+	// The shard tables use the low bits of the same hash to pick slots, so the
+	// shard is chosen from the high bits instead.
+	return *_shards[(CacheTable::get_hash(keys) >> 32U) % _shards.size()]; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+}
+
+PersistentCache::PersistentCache(const std::string & filename, const std::optional<CacheMetadata> & metadata, std::size_t cache_size, std::size_t memory_limit, std::size_t map_size) :
+		_cache{memory_limit, cache_size},
+		_env{lmdb::env::create()},
+		_queue(WRITE_QUEUE_SIZE) {
 	if (std::filesystem::exists(filename)) {
 		std::cerr << "Using existing cache database...\n";
-	} else {
+	} else if (metadata) {
 		std::cerr << "Creating new cache database...\n";
 		std::filesystem::create_directories(filename);
+	} else {
+		throw CacheError{"There is no cache at " + filename};
 	}
 
-	_env.set_mapsize(128UL * 1024UL * 1024UL * 1024UL); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
-	_env.open(filename.c_str(), MDB_NOSYNC | MDB_WRITEMAP | MDB_NOLOCK, 0664); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+	_env.set_mapsize(map_size);
+	_env.open(filename.c_str(), MDB_NOSYNC | MDB_WRITEMAP, 0664); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
 
 	auto txn{lmdb::txn::begin(_env)};
 	_dbi = lmdb::dbi::open(txn, nullptr);
 
-	txn.abort();
+	// Only an empty database is stamped with the metadata of this run, so that
+	// one written without metadata is never mistaken for a checked one.
+	std::string_view value;
+
+	if (_dbi.get(txn, METADATA_KEY, value) && value.size() == sizeof(CacheMetadata)) {
+		_metadata.emplace();
+		std::memcpy(&*_metadata, value.data(), sizeof(CacheMetadata));
+	} else if (metadata && _dbi.size(txn) == 0) {
+		_metadata = metadata;
+		_dbi.put(txn, METADATA_KEY, std::string_view{reinterpret_cast<const char *>(&*_metadata), sizeof(CacheMetadata)}); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+	}
+
+	txn.commit();
+
+	if (metadata) {
+		auto error{_get_metadata_error(filename, _metadata, *metadata)};
+
+		if (!error.empty()) {
+			throw CacheError{error};
+		}
+	}
+
+	_read_txn = lmdb::txn::begin(_env, nullptr, MDB_RDONLY);
+	_writer = std::thread{[this]() { _write(); }};
 }
 
 PersistentCache::~PersistentCache() {
-	_flush_write_queue();
+	_stopping.store(true, std::memory_order_release);
+	_writer.join();
+
+	_read_txn.abort();
 }
 
 auto PersistentCache::get(const State & state) -> std::pair<int, Milliframes> {
 	auto keys{state.get_keys()};
+	auto result{_cache.get(keys)};
 
-	if (_cache.count(keys) > 0) {
-		return _cache.at(keys);
+	if (result.first >= 0) {
+		return result;
 	}
 
-	auto txn{lmdb::txn::begin(_env, nullptr, MDB_RDONLY)};
-	auto result{std::make_pair(-1, Milliframes::max())};
+	_renew();
 
 	auto key{_encode_key(keys)};
 	std::string_view value;
 
-	if (_dbi.get(txn, key, value)) {
+	if (_dbi.get(_read_txn, std::string_view{key.data(), key.size()}, value)) {
 		result = _decode_value(value);
-	}
 
-	txn.abort();
+		if (result.first >= 0) {
+			_cache.set(keys, result.first, result.second);
+			_database_hits++;
+		}
+	}
 
 	return result;
 }
@@ -75,66 +248,643 @@ auto PersistentCache::get(const State & state) -> std::pair<int, Milliframes> {
 void PersistentCache::set(const State & state, int value, Milliframes frames) {
 	auto keys{state.get_keys()};
 
-	_cache[keys] = std::make_pair(value, frames);
+	_cache.set(keys, value, frames);
+	_push(Record{_encode_key(keys), _encode_value(value, frames)});
+}
 
-	if (_cache.size() > _cache_size) {
-		_cache.clear();
-	}
+auto PersistentCache::get_size() const -> std::size_t {
+	return _cache.get_size();
+}
 
-	auto key{_encode_key(keys)};
-	auto encoded_value{_encode_value(value, frames)};
+auto PersistentCache::get_statistics() const -> CacheStatistics {
+	auto statistics{_cache.get_statistics()};
+
+	// Lookups that missed in memory but were found in the database are hits.
+	statistics.hits += _database_hits;
+	statistics.misses -= _database_hits;
+
+	return statistics;
+}
+
+auto PersistentCache::get_metadata() const -> std::optional<CacheMetadata> {
+	return _metadata;
+}
+
+auto PersistentCache::get_stored_size() -> std::size_t {
+	_renew();
+
+	return _dbi.size(_read_txn) - (_metadata ? 1 : 0);
+}
+
+/*
+ * Returns the size of the database up to its last used page, which is how
+ * large compaction can make it at most. The file itself may be larger, as it
+ * is extended to the full map size.
+ */
+auto PersistentCache::get_disk_usage() -> std::size_t {
+	_renew();
 
-	_write_queue.emplace(key, encoded_value);
+	MDB_envinfo info{};
+	::mdb_env_info(_env.handle(), &info);
 
-	if (_write_queue.size() > MAX_QUEUE_SIZE) {
-		_flush_write_queue();
+	return (info.me_last_pgno + 1) * _dbi.stat(_read_txn).ms_psize;
+}
+
+/*
+ * Deletes every state at an index of the given number of instructions or more.
+ * This is meant for maintenance, when nothing else is using the cache.
+ */
+auto PersistentCache::strip(std::size_t instructions) -> std::size_t {
+	std::size_t removed{0};
+
+	_read_txn.reset();
+
+	auto txn{lmdb::txn::begin(_env)};
+	auto cursor{lmdb::cursor::open(txn, _dbi.handle())};
+
+	std::string_view key;
+	std::string_view value;
+
+	for (bool found{cursor.get(key, value, MDB_FIRST)}; found; found = cursor.get(key, value, MDB_NEXT)) {
+		if (key.size() != sizeof(Key)) {
+			continue;
+		}
+
+		uint64_t key2{0};
+		std::memcpy(&key2, key.data() + sizeof(uint64_t), sizeof(key2)); // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+
+		if ((key2 >> 48U) >= instructions) { // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+			lmdb::cursor_del(cursor.handle());
+			removed++;
+		}
 	}
+
+	cursor.close();
+	txn.commit();
+
+	_read_txn.renew();
+
+	return removed;
 }
 
-auto PersistentCache::get_size() const -> std::size_t {
-	return _cache.size();
+/*
+ * Rewrites the database without its free pages, replacing the original. The
+ * cache must not be open.
+ */
+void PersistentCache::compact(const std::string & filename) {
+	auto directory{filename + ".compact"};
+	std::filesystem::create_directories(directory);
+
+	{
+		auto env{lmdb::env::create()};
+		env.open(filename.c_str(), 0, 0664); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+		lmdb::env_copy(env.handle(), directory.c_str(), MDB_CP_COMPACT);
+	}
+
+	std::filesystem::rename(directory + "/data.mdb", filename + "/data.mdb");
+	std::filesystem::remove_all(directory);
 }
 
-auto PersistentCache::_encode_key(std::tuple<uint64_t, uint64_t, uint64_t> keys) -> std::string {
-	auto & [key1, key2, key3] = keys;
-	std::string result{sizeof(key1) + sizeof(key2) + sizeof(key3), 0, std::string::allocator_type{}};
+auto PersistentCache::_encode_key(const std::pair<uint64_t, uint64_t> & keys) -> Key {
+	Key result{};
 
-	std::copy_n(reinterpret_cast<char*>(&key1), sizeof(key1), result.begin()); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
-	std::copy_n(reinterpret_cast<char*>(&key2), sizeof(key2), result.begin() + sizeof(key1)); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
-	std::copy_n(reinterpret_cast<char*>(&key3), sizeof(key3), result.begin() + sizeof(key1) + sizeof(key2)); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+	std::memcpy(result.data(), &keys.first, sizeof(keys.first));
+	std::memcpy(result.data() + sizeof(keys.first), &keys.second, sizeof(keys.second)); // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
 
 	return result;
 }
 
-auto PersistentCache::_encode_value(int value, Milliframes frames) -> std::string {
-	int64_t value1{static_cast<int64_t>(value)};
-	int64_t value2{static_cast<int64_t>(frames.count())};
+/*
+ * Values are stored as in the in-memory table, with the maximum frames
+ * standing in for an unreachable result.
+ */
+auto PersistentCache::_encode_value(int value, Milliframes frames) -> Value {
+	auto value1{static_cast<int32_t>(value)};
+	auto value2{frames == Milliframes::max() ? std::numeric_limits<int32_t>::max() : static_cast<int32_t>(frames.count())};
 
-	std::string result{sizeof(int64_t) * 2, 0, std::string::allocator_type{}};
+	Value result{};
 
-	std::copy(reinterpret_cast<char*>(&value1), reinterpret_cast<char*>(&value1) + sizeof(value1), result.begin()); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast, cppcoreguidelines-pro-bounds-pointer-arithmetic)
-	std::copy(reinterpret_cast<char*>(&value2), reinterpret_cast<char*>(&value2) + sizeof(value2), result.begin() + sizeof(value1)); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast, cppcoreguidelines-pro-bounds-pointer-arithmetic)
+	std::memcpy(result.data(), &value1, sizeof(value1));
+	std::memcpy(result.data() + sizeof(value1), &value2, sizeof(value2)); // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
 
 	return result;
 }
 
+/*
+ * Decodes a value directly from the database's memory map. Values of any other
+ * size come from databases written by older versions and are ignored.
+ */
 auto PersistentCache::_decode_value(const std::string_view & data) -> std::pair<int, Milliframes> {
-	int64_t value1{0};
-	int64_t value2{0};
+	if (data.size() != sizeof(Value)) {
+		return std::make_pair(-1, Milliframes::max());
+	}
+
+	int32_t value1{0};
+	int32_t value2{0};
 
-	std::copy(data.begin(), data.begin() + sizeof(value1), reinterpret_cast<char*>(&value1)); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
-	std::copy(data.begin() + sizeof(value1), data.begin() + sizeof(value1) + sizeof(value2), reinterpret_cast<char*>(&value2)); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast, cppcoreguidelines-pro-bounds-pointer-arithmetic)
+	std::memcpy(&value1, data.data(), sizeof(value1));
+	std::memcpy(&value2, data.data() + sizeof(value1), sizeof(value2)); // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
 
-	return std::make_pair(static_cast<int>(value1), Milliframes{value2});
+	auto frames{value2 == std::numeric_limits<int32_t>::max() ? Milliframes::max() : Milliframes{value2}};
+
+	return std::make_pair(static_cast<int>(value1), frames);
 }
 
-auto PersistentCache::_flush_write_queue() noexcept -> void {
-	auto txn{lmdb::txn::begin(_env)};
+/*
+ * Writes only become visible to a read transaction started after their commit,
+ * so this picks up any batches the writer has finished since the last lookup.
+ */
+void PersistentCache::_renew() {
+	auto generation{_generation.load(std::memory_order_acquire)};
+
+	if (generation != _read_generation) {
+		_read_txn.reset();
+		_read_txn.renew();
+		_read_generation = generation;
+	}
+}
 
-	for (const auto & [key, value] : _write_queue) {
-		_dbi.put(txn, key, value);
+/*
+ * Adds a record to the write queue. This thread is the only producer, so it
+ * only has to wait when the writer has fallen a full queue behind.
+ */
+void PersistentCache::_push(const Record & record) {
+	auto tail{_queue_tail.load(std::memory_order_relaxed)};
+
+	while (tail - _queue_head.load(std::memory_order_acquire) == _queue.size()) {
+		std::this_thread::yield();
 	}
 
-	txn.commit();
-	_write_queue.clear();
+	_queue[tail % _queue.size()] = record;
+	_queue_tail.store(tail + 1, std::memory_order_release);
+}
+
+/*
+ * Runs on the writer thread, committing whatever has been queued in batches.
+ * Sorting each batch lets LMDB insert it in key order.
+ */
+void PersistentCache::_write() {
+	std::vector<Record> batch;
+	bool failed{false};
+
+	while (true) {
+		bool stopping{_stopping.load(std::memory_order_acquire)};
+
+		auto head{_queue_head.load(std::memory_order_relaxed)};
+		auto tail{_queue_tail.load(std::memory_order_acquire)};
+
+		while (head != tail && batch.size() < MAXIMUM_WRITE_BATCH_SIZE) {
+			batch.push_back(_queue[head % _queue.size()]);
+			head++;
+		}
+
+		_queue_head.store(head, std::memory_order_release);
+
+		if (batch.empty()) {
+			if (stopping) {
+				break;
+			}
+
+			std::this_thread::sleep_for(WRITE_INTERVAL);
+			continue;
+		}
+
+		std::sort(batch.begin(), batch.end(), [](const auto & first, const auto & second) {
+			return std::memcmp(first.key.data(), second.key.data(), first.key.size()) < 0;
+		});
+
+		// If the database cannot be written, keep draining the queue so that
+		// optimization can still finish using the in-memory cache.
+		if (!failed) {
+			try {
+				auto txn{lmdb::txn::begin(_env)};
+
+				for (const auto & record : batch) {
+					_dbi.put(txn, std::string_view{record.key.data(), record.key.size()}, std::string_view{record.value.data(), record.value.size()});
+				}
+
+				txn.commit();
+			} catch (const lmdb::error & e) {
+				std::cerr << "ERROR: Failed to write to the cache database: " << e.what() << '\n';
+				failed = true;
+			}
+		}
+
+		batch.clear();
+
+		_generation.fetch_add(1, std::memory_order_release);
+	}
+}
+
+MappedCache::MappedCache(const std::string & filename, const std::optional<CacheMetadata> & metadata, std::size_t shared_size) :
+		_filename{filename},
+		_shared{shared_size > 0} {
+	if (std::filesystem::exists(filename)) {
+		std::cerr << "Using existing cache file...\n";
+
+		_mapping = _open(filename, 0, _shared);
+
+		if (_mapping.file < 0) {
+			throw CacheError{"The file at " + filename + " is not a cache in a format this version of Rosa can read. Delete it or use a different cache location."};
+		}
+	} else if (metadata) {
+		std::cerr << "Creating new cache file...\n";
+
+		auto directory{std::filesystem::path{filename}.parent_path()};
+
+		if (!directory.empty()) {
+			std::filesystem::create_directories(directory);
+		}
+
+		if (_shared) {
+			_mapping = _create_shared(filename, std::max(shared_size / sizeof(Entry), static_cast<std::size_t>(1)), *metadata);
+		} else {
+			_mapping = _open(filename, MAPPED_CACHE_INITIAL_CAPACITY, false);
+			_mapping.header->metadata = *metadata;
+		}
+	} else {
+		throw CacheError{"There is no cache at " + filename};
+	}
+
+	if (metadata) {
+		auto error{_get_metadata_error(filename, _mapping.header->metadata, *metadata)};
+
+		if (!error.empty()) {
+			_close(&_mapping);
+			throw CacheError{error};
+		}
+	}
+}
+
+MappedCache::~MappedCache() {
+	_close(&_mapping);
+}
+
+auto MappedCache::get(const State & state) -> std::pair<int, Milliframes> {
+	auto keys{state.get_keys()};
+
+	if (_shared) {
+		return _get_shared(keys);
+	}
+
+	const auto & entry{_mapping.entries[_find(_mapping, keys)]}; // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+
+	if (entry.data == 0) {
+		_misses++;
+		return std::make_pair(-1, Milliframes::max());
+	}
+
+	_hits++;
+
+	return _decode(entry.data);
+}
+
+void MappedCache::set(const State & state, int value, Milliframes frames) {
+	auto keys{state.get_keys()};
+
+	if (_shared) {
+		_set_shared(keys, _encode(value, frames));
+		return;
+	}
+
+	auto index{_find(_mapping, keys)};
+
+	if (_mapping.entries[index].data == 0) { // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+		if ((_mapping.header->size + 1) * MAPPED_CACHE_LOAD_DENOMINATOR > _mapping.header->capacity * MAPPED_CACHE_LOAD_NUMERATOR) {
+			_rebuild(&_mapping, _filename, _mapping.header->capacity * 2, std::numeric_limits<std::size_t>::max());
+			index = _find(_mapping, keys);
+		}
+
+		_mapping.header->size++;
+	}
+
+	_mapping.entries[index] = Entry{keys.first, keys.second, _encode(value, frames)}; // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+}
+
+void MappedCache::prefetch(const State & state) const {
+	__builtin_prefetch(&_mapping.entries[CacheTable::get_hash(state.get_keys()) % _mapping.header->capacity]); // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+}
+
+auto MappedCache::get_size() const -> std::size_t {
+	return __atomic_load_n(&_mapping.header->size, __ATOMIC_RELAXED) + _overflow.get_size();
+}
+
+auto MappedCache::get_statistics() const -> CacheStatistics {
+	CacheStatistics statistics{__atomic_load_n(&_mapping.header->size, __ATOMIC_RELAXED), _mapping.header->capacity, _mapping.length, _hits, _misses, 0};
+
+	if (_full) {
+		auto overflow{_overflow.get_statistics()};
+
+		statistics.size += overflow.size;
+		statistics.capacity += overflow.capacity;
+		statistics.memory_usage += overflow.memory_usage;
+	}
+
+	return statistics;
+}
+
+auto MappedCache::get_metadata() const -> std::optional<CacheMetadata> {
+	return _mapping.header->metadata;
+}
+
+auto MappedCache::get_stored_size() -> std::size_t {
+	return _mapping.header->size;
+}
+
+auto MappedCache::get_disk_usage() -> std::size_t {
+	return _mapping.length;
+}
+
+/*
+ * Deletes every state at an index of the given number of instructions or more
+ * by copying the rest into a new table of the same capacity.
+ */
+auto MappedCache::strip(std::size_t instructions) -> std::size_t {
+	auto size{_mapping.header->size};
+
+	_rebuild(&_mapping, _filename, _mapping.header->capacity, instructions);
+
+	return size - _mapping.header->size;
+}
+
+/*
+ * Shrinks the table to the smallest capacity it could have grown to for its
+ * current number of entries. The cache must not be open.
+ */
+void MappedCache::compact(const std::string & filename) {
+	auto mapping{_open(filename, 0, false)};
+
+	if (mapping.file < 0) {
+		throw CacheError{"The file at " + filename + " is not a cache in a format this version of Rosa can read."};
+	}
+
+	auto capacity{MAPPED_CACHE_INITIAL_CAPACITY};
+
+	while (mapping.header->size * MAPPED_CACHE_LOAD_DENOMINATOR > capacity * MAPPED_CACHE_LOAD_NUMERATOR) {
+		capacity *= 2;
+	}
+
+	if (capacity < mapping.header->capacity) {
+		_rebuild(&mapping, filename, capacity, std::numeric_limits<std::size_t>::max());
+	}
+
+	_close(&mapping);
+}
+
+/*
+ * Maps the given file. With a capacity, the file is replaced by an empty table
+ * of that many slots. Without one, the existing table is used, or an unmapped
+ * result is returned if the file does not hold one in the current format.
+ *
+ * Runs sharing a cache hold a shared lock on its file, while any other use of
+ * it needs an exclusive lock, as the file may be replaced when it grows.
+ */
+auto MappedCache::_open(const std::string & filename, uint64_t capacity, bool shared) -> Mapping {
+	Mapping mapping;
+	Header header;
+
+	if (capacity > 0) {
+		header = Header{MAPPED_CACHE_MAGIC, MAPPED_CACHE_VERSION, sizeof(Entry), capacity, 0};
+		mapping.file = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0664); // NOLINT(cppcoreguidelines-avoid-magic-numbers,cppcoreguidelines-pro-type-vararg,readability-magic-numbers)
+	} else {
+		mapping.file = ::open(filename.c_str(), O_RDWR); // NOLINT(cppcoreguidelines-pro-type-vararg)
+	}
+
+	if (mapping.file < 0) {
+		throw std::system_error{errno, std::generic_category(), "Failed to open " + filename};
+	}
+
+	if (::flock(mapping.file, (shared ? LOCK_SH : LOCK_EX) | LOCK_NB) != 0) {
+		::close(mapping.file);
+		throw CacheError{"The cache at " + filename + " is in use by another run" + (shared ? " that is not sharing it." : ".")};
+	}
+
+	if (capacity > 0) {
+		mapping.length = sizeof(Header) + capacity * sizeof(Entry);
+
+		if (::ftruncate(mapping.file, static_cast<off_t>(mapping.length)) != 0) {
+			auto error{errno};
+			::close(mapping.file);
+			throw std::system_error{error, std::generic_category(), "Failed to resize " + filename};
+		}
+	} else {
+		struct stat status{};
+
+		bool valid{::pread(mapping.file, &header, sizeof(header), 0) == sizeof(header) && ::fstat(mapping.file, &status) == 0};
+		valid = valid && header.magic == MAPPED_CACHE_MAGIC && header.version == MAPPED_CACHE_VERSION && header.entry_size == sizeof(Entry);
+		valid = valid && header.capacity > 0 && static_cast<uint64_t>(status.st_size) == sizeof(Header) + header.capacity * sizeof(Entry);
+
+		if (!valid) {
+			::close(mapping.file);
+			return Mapping{};
+		}
+
+		mapping.length = static_cast<std::size_t>(status.st_size);
+	}
+
+	auto * address{::mmap(nullptr, mapping.length, PROT_READ | PROT_WRITE, MAP_SHARED, mapping.file, 0)};
+
+	if (address == MAP_FAILED) { // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+		auto error{errno};
+		::close(mapping.file);
+		throw std::system_error{error, std::generic_category(), "Failed to map " + filename};
+	}
+
+	// Probes land anywhere in the table, so reading ahead would only waste
+	// page cache.
+	::madvise(address, mapping.length, MADV_RANDOM);
+
+	mapping.header = static_cast<Header *>(address);
+	mapping.entries = reinterpret_cast<Entry *>(static_cast<char *>(address) + sizeof(Header)); // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic,cppcoreguidelines-pro-type-reinterpret-cast)
+
+	if (capacity > 0) {
+		*mapping.header = header;
+	}
+
+	return mapping;
+}
+
+/*
+ * Creates a shared cache under a temporary name and then links it into place,
+ * so that other runs never see a partly initialized file. If another run
+ * created the cache first, its file is used instead.
+ */
+auto MappedCache::_create_shared(const std::string & filename, uint64_t capacity, const CacheMetadata & metadata) -> Mapping {
+	auto temporary_filename{(boost::format("%s.%d.tmp") % filename % ::getpid()).str()};
+	auto mapping{_open(temporary_filename, capacity, true)};
+
+	mapping.header->metadata = metadata;
+
+	auto result{::link(temporary_filename.c_str(), filename.c_str())};
+	auto error{errno};
+
+	::unlink(temporary_filename.c_str());
+
+	if (result == 0) {
+		return mapping;
+	}
+
+	_close(&mapping);
+
+	if (error != EEXIST) {
+		throw std::system_error{error, std::generic_category(), "Failed to create " + filename};
+	}
+
+	mapping = _open(filename, 0, true);
+
+	if (mapping.file < 0) {
+		throw CacheError{"The file at " + filename + " is not a cache in a format this version of Rosa can read. Delete it or use a different cache location."};
+	}
+
+	return mapping;
+}
+
+void MappedCache::_close(Mapping * mapping) {
+	if (mapping->file >= 0) {
+		::munmap(mapping->header, mapping->length);
+		::close(mapping->file);
+	}
+
+	*mapping = Mapping{};
+}
+
+auto MappedCache::_find(const Mapping & mapping, const std::pair<uint64_t, uint64_t> & keys) -> std::size_t {
+	auto capacity{mapping.header->capacity};
+	auto index{CacheTable::get_hash(keys) % capacity};
+
+	while (true) {
+		const auto & entry{mapping.entries[index]}; // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+
+		if (entry.data == 0 || (entry.key1 == keys.first && entry.key2 == keys.second)) {
+			return index;
+		}
+
+		index = index + 1 == capacity ? 0 : index + 1;
+	}
+}
+
+/*
+ * Copies the table into a new file of the given capacity beside the old one,
+ * keeping only the states at indices before the given number of instructions,
+ * and renames it over the original once every entry has been copied, so that
+ * an interrupted run never leaves a partial table behind. Slots left claimed
+ * by a shared run that was killed while writing them are dropped.
+ */
+void MappedCache::_rebuild(Mapping * mapping, const std::string & filename, uint64_t capacity, std::size_t instructions) {
+	auto temporary_filename{filename + ".tmp"};
+	auto result{_open(temporary_filename, capacity, false)};
+
+	result.header->metadata = mapping->header->metadata;
+
+	for (uint64_t index = 0; index < mapping->header->capacity; index++) {
+		const auto & entry{mapping->entries[index]}; // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+
+		if (entry.data != 0 && entry.data != MAPPED_CACHE_BUSY && (entry.key2 >> 48U) < instructions) { // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+			result.entries[_find(result, std::make_pair(entry.key1, entry.key2))] = entry; // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+			result.header->size++;
+		}
+	}
+
+	_close(mapping);
+	std::filesystem::rename(temporary_filename, filename);
+
+	*mapping = result;
+}
+
+auto MappedCache::_encode(int value, Milliframes frames) -> uint64_t {
+	auto frames_data{frames == Milliframes::max() ? std::numeric_limits<int32_t>::max() : static_cast<int32_t>(frames.count())};
+
+	return static_cast<uint64_t>(static_cast<uint32_t>(value + 1)) | (static_cast<uint64_t>(static_cast<uint32_t>(frames_data)) << 32U); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+}
+
+auto MappedCache::_decode(uint64_t data) -> std::pair<int, Milliframes> {
+	auto value{static_cast<int32_t>(static_cast<uint32_t>(data)) - 1};
+	auto frames_data{static_cast<int32_t>(static_cast<uint32_t>(data >> 32U))}; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+
+	return std::make_pair(static_cast<int>(value), frames_data == std::numeric_limits<int32_t>::max() ? Milliframes::max() : Milliframes{frames_data});
+}
+
+/*
+ * Looks up a state in a shared cache. The keys of a slot are only read once
+ * its data word shows that they have been published. A slot still being
+ * claimed is skipped, so a state that another run is inserting at the same
+ * moment may be missed, which only costs solving it again.
+ */
+auto MappedCache::_get_shared(const std::pair<uint64_t, uint64_t> & keys) -> std::pair<int, Milliframes> {
+	auto capacity{_mapping.header->capacity};
+	auto index{CacheTable::get_hash(keys) % capacity};
+
+	while (true) {
+		auto & entry{_mapping.entries[index]}; // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+		auto data{__atomic_load_n(&entry.data, __ATOMIC_ACQUIRE)};
+
+		if (data == 0) {
+			break;
+		}
+
+		if (data != MAPPED_CACHE_BUSY && entry.key1 == keys.first && entry.key2 == keys.second) {
+			_hits++;
+			return _decode(data);
+		}
+
+		index = index + 1 == capacity ? 0 : index + 1;
+	}
+
+	if (_full) {
+		auto result{_overflow.get(keys)};
+
+		if (result.first >= 0) {
+			_hits++;
+			return result;
+		}
+	}
+
+	_misses++;
+
+	return std::make_pair(-1, Milliframes::max());
+}
+
+/*
+ * Inserts a state into a shared cache, unless it is already there. Results are
+ * the same no matter which run solves a state, so the first one stored wins.
+ * Two runs inserting the same state at once may each claim a slot for it,
+ * which only wastes the second slot.
+ */
+void MappedCache::_set_shared(const std::pair<uint64_t, uint64_t> & keys, uint64_t data) {
+	auto capacity{_mapping.header->capacity};
+
+	if (!_full && __atomic_load_n(&_mapping.header->size, __ATOMIC_RELAXED) * MAPPED_CACHE_LOAD_DENOMINATOR >= capacity * MAPPED_CACHE_LOAD_NUMERATOR) {
+		std::cerr << "WARNING: The shared cache is full... keeping further states in memory\n";
+		_full = true;
+	}
+
+	if (_full) {
+		_overflow.set(keys, _decode(data).first, _decode(data).second);
+		return;
+	}
+
+	auto index{CacheTable::get_hash(keys) % capacity};
+
+	while (true) {
+		auto & entry{_mapping.entries[index]}; // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+		auto current{__atomic_load_n(&entry.data, __ATOMIC_ACQUIRE)};
+
+		if (current == 0) {
+			if (__atomic_compare_exchange_n(&entry.data, &current, MAPPED_CACHE_BUSY, false, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+				entry.key1 = keys.first;
+				entry.key2 = keys.second;
+
+				__atomic_store_n(&entry.data, data, __ATOMIC_RELEASE);
+				__atomic_fetch_add(&_mapping.header->size, 1, __ATOMIC_RELAXED);
+
+				return;
+			}
+		}
+
+		if (current != MAPPED_CACHE_BUSY && entry.key1 == keys.first && entry.key2 == keys.second) {
+			return;
+		}
+
+		index = index + 1 == capacity ? 0 : index + 1;
+	}
 }
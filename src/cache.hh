@@ -1,21 +1,30 @@
 #ifndef ROSA_CACHE_HH
 #define ROSA_CACHE_HH
 
+#include "cache_metadata.hh"
+#include "cache_table.hh"
 #include "duration.hh"
 #include "state.hh"
 
 #include "lmdb++.h"
 
-#include <boost/functional/hash.hpp>
-#include <tsl/sparse_map.h>
-
+#include <array>
+#include <atomic>
 #include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
 #include <string>
-#include <tuple>
+#include <thread>
+#include <utility>
+#include <vector>
 
 enum class CacheType {
 	Dynamic,
-	Persistent
+	Persistent,
+	Mapped,
+	Shared
 };
 
 class Cache {
@@ -30,24 +39,93 @@ class Cache {
 
 		virtual auto get(const State & state) -> std::pair<int, Milliframes> = 0;
 		virtual void set(const State & state, int value, Milliframes frames) = 0;
+		virtual void prefetch(const State & state) const;
+
+		virtual void get_entries(std::vector<CacheTable::Entry> * entries) const;
+		virtual void insert(const std::vector<CacheTable::Entry> & entries);
 
 		[[nodiscard]] virtual auto get_size() const -> std::size_t = 0;
+		[[nodiscard]] virtual auto get_statistics() const -> CacheStatistics = 0;
+};
+
+class CacheError : public std::runtime_error {
+	public:
+		using std::runtime_error::runtime_error;
+};
+
+/*
+ * A cache stored on disk, which may outlive a run. Each one records the
+ * metadata of the run that created it and refuses to open for a run with
+ * different metadata. Without metadata, an existing cache is opened as it is
+ * for maintenance.
+ */
+class DiskCache : public Cache {
+	public:
+		[[nodiscard]] virtual auto get_metadata() const -> std::optional<CacheMetadata> = 0;
+		[[nodiscard]] virtual auto get_stored_size() -> std::size_t = 0;
+		[[nodiscard]] virtual auto get_disk_usage() -> std::size_t = 0;
+
+		virtual auto strip(std::size_t instructions) -> std::size_t = 0;
+
+	protected:
+		static auto _get_metadata_error(const std::string & filename, const std::optional<CacheMetadata> & stored, const CacheMetadata & expected) -> std::string;
 };
 
 class DynamicCache : public Cache {
 	public:
+		explicit DynamicCache(std::size_t memory_limit);
+
+		auto get(const State & state) -> std::pair<int, Milliframes> override;
+		void set(const State & state, int value, Milliframes frames) override;
+		void prefetch(const State & state) const override;
+
+		void get_entries(std::vector<CacheTable::Entry> * entries) const override;
+		void insert(const std::vector<CacheTable::Entry> & entries) override;
+
+		[[nodiscard]] auto get_size() const -> std::size_t override;
+		[[nodiscard]] auto get_statistics() const -> CacheStatistics override;
+
+	private:
+		CacheTable _cache;
+};
+
+class ConcurrentCache : public Cache {
+	public:
+		ConcurrentCache(std::size_t shards, std::size_t memory_limit);
+
 		auto get(const State & state) -> std::pair<int, Milliframes> override;
 		void set(const State & state, int value, Milliframes frames) override;
 
+		void get_entries(std::vector<CacheTable::Entry> * entries) const override;
+		void insert(const std::vector<CacheTable::Entry> & entries) override;
+
 		[[nodiscard]] auto get_size() const -> std::size_t override;
+		[[nodiscard]] auto get_statistics() const -> CacheStatistics override;
 
 	private:
-		tsl::sparse_map<std::tuple<uint64_t, uint64_t, uint64_t>, std::pair<int, Milliframes>, boost::hash<std::tuple<uint64_t, uint64_t, uint64_t>>> _cache;
+		struct Shard {
+			explicit Shard(std::size_t memory_limit) : cache{memory_limit} { }
+
+			mutable std::mutex mutex{};
+			CacheTable cache;
+		};
+
+		auto _get_shard(const std::pair<uint64_t, uint64_t> & keys) const -> Shard &;
+
+		std::vector<std::unique_ptr<Shard>> _shards;
 };
 
-class PersistentCache : public Cache {
+/*
+ * Stores every state in an LMDB database as well as in memory. Lookups share
+ * a single long-lived read transaction, which is renewed whenever new writes
+ * have been committed. Writes are handed to a background thread through a
+ * single-producer, single-consumer ring buffer and committed in large sorted
+ * batches, so optimization never waits on the database unless the buffer is
+ * full.
+ */
+class PersistentCache : public DiskCache {
 	public:
-		explicit PersistentCache(const std::string & filename, std::size_t cache_size);
+		PersistentCache(const std::string & filename, const std::optional<CacheMetadata> & metadata, std::size_t cache_size, std::size_t memory_limit, std::size_t map_size);
 		PersistentCache(const PersistentCache &) = delete;
 		PersistentCache(const PersistentCache &&) = delete;
 		auto operator=(const PersistentCache &) -> PersistentCache & = delete;
@@ -59,21 +137,136 @@ class PersistentCache : public Cache {
 		void set(const State & state, int value, Milliframes frames) override;
 
 		[[nodiscard]] auto get_size() const -> std::size_t override;
+		[[nodiscard]] auto get_statistics() const -> CacheStatistics override;
+
+		[[nodiscard]] auto get_metadata() const -> std::optional<CacheMetadata> override;
+		[[nodiscard]] auto get_stored_size() -> std::size_t override;
+		[[nodiscard]] auto get_disk_usage() -> std::size_t override;
+
+		auto strip(std::size_t instructions) -> std::size_t override;
+
+		static void compact(const std::string & filename);
 
 	private:
-		static auto _encode_key(std::tuple<uint64_t, uint64_t, uint64_t> keys) -> std::string;
-		static auto _encode_value(int value, Milliframes frames) -> std::string;
-		static auto _decode_value(const std::string_view & data) -> std::pair<int, Milliframes>;
+		using Key = std::array<char, sizeof(uint64_t) * 2>;
+		using Value = std::array<char, sizeof(int32_t) * 2>;
 
-		void _flush_write_queue() noexcept;
+		struct Record {
+			Key key{};
+			Value value{};
+		};
+
+		static auto _encode_key(const std::pair<uint64_t, uint64_t> & keys) -> Key;
+		static auto _encode_value(int value, Milliframes frames) -> Value;
+		static auto _decode_value(const std::string_view & data) -> std::pair<int, Milliframes>;
 
-		tsl::sparse_map<std::tuple<uint64_t, uint64_t, uint64_t>, std::pair<int, Milliframes>, boost::hash<std::tuple<uint64_t, uint64_t, uint64_t>>> _cache;
-		std::map<std::string, std::string> _write_queue;
+		void _push(const Record & record);
+		void _write();
+		void _renew();
 
-		const std::size_t _cache_size;
+		CacheTable _cache;
+		std::optional<CacheMetadata> _metadata;
 
 		lmdb::env _env;
 		lmdb::dbi _dbi;
+		lmdb::txn _read_txn{nullptr};
+		uint64_t _read_generation{0};
+		uint64_t _database_hits{0};
+
+		std::vector<Record> _queue;
+		std::atomic<std::size_t> _queue_head{0};
+		std::atomic<std::size_t> _queue_tail{0};
+		std::atomic<uint64_t> _generation{0};
+		std::atomic<bool> _stopping{false};
+		std::thread _writer;
+};
+
+/*
+ * Stores every state in a memory-mapped file: a header holding the metadata
+ * and the size of the table, followed by an open-addressing table of the same
+ * 24-byte slots as the in-memory table. There are no transactions, so the
+ * kernel's page cache keeps the most used parts of the table in memory and
+ * writes the rest back to disk as it sees fit. The table grows by building a
+ * file twice the size beside the old one, which then replaces it.
+ *
+ * With a shared size, the cache instead creates a table of that size and never
+ * grows it, so that several runs can map the same file at once. A slot is
+ * claimed by an atomic compare-and-swap on its data word and published by an
+ * atomic store once its keys are written, so no locks are needed. States that
+ * no longer fit once the table is full are kept in memory instead.
+ */
+class MappedCache : public DiskCache {
+	public:
+		MappedCache(const std::string & filename, const std::optional<CacheMetadata> & metadata, std::size_t shared_size = 0);
+		MappedCache(const MappedCache &) = delete;
+		MappedCache(const MappedCache &&) = delete;
+		auto operator=(const MappedCache &) -> MappedCache & = delete;
+		auto operator=(const MappedCache &&) -> MappedCache && = delete;
+
+		~MappedCache() override;
+
+		auto get(const State & state) -> std::pair<int, Milliframes> override;
+		void set(const State & state, int value, Milliframes frames) override;
+		void prefetch(const State & state) const override;
+
+		[[nodiscard]] auto get_size() const -> std::size_t override;
+		[[nodiscard]] auto get_statistics() const -> CacheStatistics override;
+
+		[[nodiscard]] auto get_metadata() const -> std::optional<CacheMetadata> override;
+		[[nodiscard]] auto get_stored_size() -> std::size_t override;
+		[[nodiscard]] auto get_disk_usage() -> std::size_t override;
+
+		auto strip(std::size_t instructions) -> std::size_t override;
+
+		static void compact(const std::string & filename);
+
+	private:
+		struct Header {
+			std::array<char, 8> magic{};
+			uint32_t version{0};
+			uint32_t entry_size{0};
+			uint64_t capacity{0};
+			uint64_t size{0};
+			CacheMetadata metadata{};
+		};
+
+		// The data word holds the value plus one in its low half and the frames
+		// in its high half, so that the zeroed pages of a newly extended file
+		// read as empty slots without ever being written.
+		struct Entry {
+			uint64_t key1{0};
+			uint64_t key2{0};
+			uint64_t data{0};
+		};
+
+		struct Mapping {
+			int file{-1};
+			std::size_t length{0};
+			Header * header{nullptr};
+			Entry * entries{nullptr};
+		};
+
+		static auto _open(const std::string & filename, uint64_t capacity, bool shared) -> Mapping;
+		static auto _create_shared(const std::string & filename, uint64_t capacity, const CacheMetadata & metadata) -> Mapping;
+		static void _close(Mapping * mapping);
+		static auto _find(const Mapping & mapping, const std::pair<uint64_t, uint64_t> & keys) -> std::size_t;
+		static void _rebuild(Mapping * mapping, const std::string & filename, uint64_t capacity, std::size_t instructions);
+
+		static auto _encode(int value, Milliframes frames) -> uint64_t;
+		static auto _decode(uint64_t data) -> std::pair<int, Milliframes>;
+
+		auto _get_shared(const std::pair<uint64_t, uint64_t> & keys) -> std::pair<int, Milliframes>;
+		void _set_shared(const std::pair<uint64_t, uint64_t> & keys, uint64_t data);
+
+		std::string _filename;
+		Mapping _mapping;
+
+		const bool _shared;
+		CacheTable _overflow{};
+		bool _full{false};
+
+		uint64_t _hits{0};
+		uint64_t _misses{0};
 };
 
 #endif // ROSA_CACHE_HH
@@ -0,0 +1,66 @@
+#include "cache_metadata.hh"
+
+#include <boost/format.hpp>
+
+#include <algorithm>
+
+constexpr uint64_t FNV_PRIME = 0x100000001B3ULL;
+
+CacheMetadata::CacheMetadata(const std::string & version, uint64_t route_hash, uint64_t data_hash, std::size_t instructions, int maximum_extra_steps, bool tas_mode) :
+		route_hash{route_hash},
+		data_hash{data_hash},
+		instructions{instructions},
+		maximum_extra_steps{maximum_extra_steps},
+		tas_mode{tas_mode ? 1 : 0} {
+	// The version is truncated if necessary, always leaving a terminator.
+	std::copy_n(version.begin(), std::min(version.size(), this->version.size() - 1), this->version.begin());
+}
+
+auto CacheMetadata::get_version() const -> std::string {
+	return std::string{version.data()};
+}
+
+/*
+ * Describes each way in which a cache created with this metadata differs from
+ * the given metadata, or returns an empty list if it can be reused.
+ */
+auto CacheMetadata::get_differences(const CacheMetadata & other) const -> std::vector<std::string> {
+	std::vector<std::string> differences;
+
+	if (version != other.version) {
+		differences.push_back((boost::format("Rosa version %s instead of %s") % get_version() % other.get_version()).str());
+	}
+
+	if ((route_hash == 0) != (other.route_hash == 0)) {
+		differences.emplace_back(route_hash == 0 ? "suffix keys enabled instead of disabled" : "suffix keys disabled instead of enabled");
+	} else if (route_hash != other.route_hash || instructions != other.instructions) {
+		differences.emplace_back("a different route");
+	}
+
+	if (data_hash != other.data_hash) {
+		differences.emplace_back("different encounter or map data");
+	}
+
+	if (maximum_extra_steps != other.maximum_extra_steps) {
+		differences.push_back((boost::format("maximum extra steps %d instead of %d") % maximum_extra_steps % other.maximum_extra_steps).str());
+	}
+
+	if (tas_mode != other.tas_mode) {
+		differences.emplace_back(tas_mode != 0 ? "TAS mode enabled instead of disabled" : "TAS mode disabled instead of enabled");
+	}
+
+	return differences;
+}
+
+/*
+ * Returns the 64-bit FNV-1a hash of the given data, continuing from the given
+ * hash so that several files can be hashed together. Unlike std::hash, this is
+ * stable across platforms and builds, as it is stored on disk.
+ */
+auto CacheMetadata::hash(const std::string & data, uint64_t hash) -> uint64_t {
+	for (const auto & character : data) {
+		hash = (hash ^ static_cast<uint8_t>(character)) * FNV_PRIME;
+	}
+
+	return hash;
+}
@@ -0,0 +1,39 @@
+#ifndef ROSA_CACHE_METADATA_HH
+#define ROSA_CACHE_METADATA_HH
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/*
+ * Identifies everything the results stored in a persistent or mapped cache
+ * depend on, so that a cache is never silently reused for a different problem.
+ * The route and data set are identified by hashes of their files, except that
+ * a cache with suffix keys records no route, as it may be shared by any route.
+ * The maximum number of step segments is not recorded, as it is part of every
+ * state.
+ */
+struct CacheMetadata {
+	CacheMetadata() = default;
+	CacheMetadata(const std::string & version, uint64_t route_hash, uint64_t data_hash, std::size_t instructions, int maximum_extra_steps, bool tas_mode);
+
+	[[nodiscard]] auto get_version() const -> std::string;
+	[[nodiscard]] auto get_differences(const CacheMetadata & other) const -> std::vector<std::string>;
+
+	static auto hash(const std::string & data, uint64_t hash = FNV_OFFSET_BASIS) -> uint64_t;
+
+	static constexpr uint64_t FNV_OFFSET_BASIS = 0xCBF29CE484222325ULL;
+
+	std::array<char, 32> version{};
+	uint64_t route_hash{0};
+	uint64_t data_hash{0};
+	uint64_t instructions{0};
+	int32_t maximum_extra_steps{0};
+	int32_t tas_mode{0};
+};
+
+static_assert(std::is_trivially_copyable_v<CacheMetadata>);
+
+#endif // ROSA_CACHE_METADATA_HH
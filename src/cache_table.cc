@@ -0,0 +1,246 @@
+#include "cache_table.hh"
+
+#include <algorithm>
+
+constexpr std::size_t INITIAL_CAPACITY = 1024;
+constexpr std::size_t MAXIMUM_LOAD_NUMERATOR = 3;
+constexpr std::size_t MAXIMUM_LOAD_DENOMINATOR = 4;
+constexpr std::size_t FINAL_GROWTH_DIVISOR = 8;
+constexpr uint64_t MAXIMUM_WEIGHT = UINT8_MAX;
+
+auto CacheStatistics::operator+=(const CacheStatistics & other) -> CacheStatistics & {
+	size += other.size;
+	capacity += other.capacity;
+	memory_usage += other.memory_usage;
+	hits += other.hits;
+	misses += other.misses;
+	evictions += other.evictions;
+
+	return *this;
+}
+
+CacheTable::CacheTable(std::size_t memory_limit, std::size_t maximum_size) :
+		_entries(INITIAL_CAPACITY),
+		_memory_limit{memory_limit},
+		_maximum_size{std::max(maximum_size, static_cast<std::size_t>(1))} {
+	if (_memory_limit > 0 || _maximum_size < std::numeric_limits<std::size_t>::max()) {
+		_weights.resize(_entries.size());
+	}
+}
+
+auto CacheTable::get(const std::pair<uint64_t, uint64_t> & keys) -> std::pair<int, Milliframes> {
+	auto index{_find(keys)};
+	const auto & entry{_entries[index]};
+
+	if (entry.value == EMPTY) {
+		_misses++;
+		return std::make_pair(-1, Milliframes::max());
+	}
+
+	_hits++;
+
+	auto frames{entry.frames == std::numeric_limits<int32_t>::max() ? Milliframes::max() : Milliframes{entry.frames}};
+
+	if (!_weights.empty()) {
+		_weights[index] = _get_weight(frames);
+	}
+
+	return std::make_pair(entry.value, frames);
+}
+
+void CacheTable::set(const std::pair<uint64_t, uint64_t> & keys, int value, Milliframes frames) {
+	auto index{_find(keys)};
+
+	if (_entries[index].value == EMPTY) {
+		if (_size >= _maximum_size) {
+			_evict();
+			index = _find(keys);
+		} else if ((_size + 1) * MAXIMUM_LOAD_DENOMINATOR > _entries.size() * MAXIMUM_LOAD_NUMERATOR) {
+			if (!_grow()) {
+				_evict();
+			}
+
+			index = _find(keys);
+		}
+
+		_size++;
+	}
+
+	auto & entry{_entries[index]};
+
+	entry.key1 = keys.first;
+	entry.key2 = keys.second;
+	entry.value = static_cast<int32_t>(value);
+	entry.frames = frames == Milliframes::max() ? std::numeric_limits<int32_t>::max() : static_cast<int32_t>(frames.count());
+
+	if (!_weights.empty()) {
+		_weights[index] = _get_weight(frames);
+	}
+}
+
+/*
+ * Hints that the slot for the given keys will soon be needed, so that the
+ * cache miss can overlap with other work.
+ */
+void CacheTable::prefetch(const std::pair<uint64_t, uint64_t> & keys) const {
+	__builtin_prefetch(&_entries[get_hash(keys) % _entries.size()]);
+}
+
+/*
+ * Appends a copy of every entry in the table, in slot order.
+ */
+void CacheTable::get_entries(std::vector<Entry> * entries) const {
+	entries->reserve(entries->size() + _size);
+
+	for (const auto & entry : _entries) {
+		if (entry.value != EMPTY) {
+			entries->push_back(entry);
+		}
+	}
+}
+
+void CacheTable::insert(const Entry & entry) {
+	set(std::make_pair(entry.key1, entry.key2), entry.value, entry.frames == std::numeric_limits<int32_t>::max() ? Milliframes::max() : Milliframes{entry.frames});
+}
+
+auto CacheTable::get_size() const -> std::size_t {
+	return _size;
+}
+
+auto CacheTable::get_statistics() const -> CacheStatistics {
+	return CacheStatistics{_size, _entries.size(), _entries.size() * sizeof(Entry) + _weights.size(), _hits, _misses, _evictions};
+}
+
+/*
+ * Returns how many passes of the hand an entry survives after it is used. The
+ * subtree that would have to be solved again without an entry grows
+ * exponentially with the decisions left after it, which the frames remaining
+ * from its state track closely. The weight is therefore proportional to those
+ * frames, relative to the most seen so far, so that entries near the start of
+ * the route outlast those near the end by up to the full range of a weight.
+ */
+auto CacheTable::_get_weight(Milliframes frames) -> uint8_t {
+	if (frames == Milliframes::max()) {
+		return 1;
+	}
+
+	auto count{static_cast<uint64_t>(std::max(frames.count(), static_cast<int64_t>(0)))};
+	_maximum_frames = std::max(_maximum_frames, count);
+
+	return static_cast<uint8_t>(1 + count * (MAXIMUM_WEIGHT - 1) / std::max(_maximum_frames, static_cast<uint64_t>(1)));
+}
+
+auto CacheTable::get_hash(const std::pair<uint64_t, uint64_t> & keys) -> uint64_t {
+	auto hash{keys.first ^ (keys.second * 0x9E3779B97F4A7C15ULL)}; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+
+	hash = (hash ^ (hash >> 30U)) * 0xBF58476D1CE4E5B9ULL; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+	hash = (hash ^ (hash >> 27U)) * 0x94D049BB133111EBULL; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+
+	return hash ^ (hash >> 31U); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+}
+
+/*
+ * Returns the slot that holds the given keys, or the empty slot where they
+ * would be inserted. The table is never full, so the probe always ends.
+ */
+auto CacheTable::_find(const std::pair<uint64_t, uint64_t> & keys) const -> std::size_t {
+	auto index{get_hash(keys) % _entries.size()};
+
+	while (true) {
+		const auto & entry{_entries[index]};
+
+		if (entry.value == EMPTY || (entry.key1 == keys.first && entry.key2 == keys.second)) {
+			return index;
+		}
+
+		index = index + 1 == _entries.size() ? 0 : index + 1;
+	}
+}
+
+/*
+ * Doubles the number of slots, or returns false if the limits do not allow it.
+ * Under a memory limit, the table doubles until it would pass an eighth of the
+ * slots the limit allows, and then grows straight to every slot that is left
+ * while the old ones are still held, so that at least seven eighths of the
+ * limit end up in use.
+ */
+auto CacheTable::_grow() -> bool {
+	auto capacity{_entries.size() * 2};
+
+	if (_memory_limit > 0) {
+		auto maximum_capacity{_memory_limit / (sizeof(Entry) + sizeof(uint8_t))};
+
+		if (capacity > maximum_capacity / FINAL_GROWTH_DIVISOR) {
+			capacity = maximum_capacity - std::min(maximum_capacity, _entries.size());
+		}
+	}
+
+	if (capacity <= _entries.size()) {
+		return false;
+	}
+
+	std::vector<Entry> entries(capacity);
+	std::swap(entries, _entries);
+
+	for (const auto & entry : entries) {
+		if (entry.value != EMPTY) {
+			_entries[_find(std::make_pair(entry.key1, entry.key2))] = entry;
+		}
+	}
+
+	if (!_weights.empty()) {
+		_weights.assign(_entries.size(), 0);
+	}
+
+	_hand = 0;
+
+	return true;
+}
+
+void CacheTable::_evict() {
+	while (_entries[_hand].value == EMPTY || _weights[_hand] > 0) {
+		if (_weights[_hand] > 0) {
+			_weights[_hand]--;
+		}
+
+		_hand = _hand + 1 == _entries.size() ? 0 : _hand + 1;
+	}
+
+	_erase(_hand);
+	_evictions++;
+}
+
+/*
+ * Removes the entry in the given slot, shifting later entries of the same
+ * probe sequence back so that no lookup stops early at the new gap.
+ */
+void CacheTable::_erase(std::size_t index) {
+	auto gap{index};
+	auto next{index};
+
+	while (true) {
+		next = next + 1 == _entries.size() ? 0 : next + 1;
+
+		const auto & entry{_entries[next]};
+
+		if (entry.value == EMPTY) {
+			break;
+		}
+
+		auto home{get_hash(std::make_pair(entry.key1, entry.key2)) % _entries.size()};
+
+		// The entry may fill the gap only if its home slot is not between the
+		// gap and its current slot, wrapping around the end of the table.
+		bool movable{gap <= next ? (home <= gap || home > next) : (home <= gap && home > next)};
+
+		if (movable) {
+			_entries[gap] = entry;
+			_weights[gap] = _weights[next];
+			gap = next;
+		}
+	}
+
+	_entries[gap] = Entry{};
+	_weights[gap] = 0;
+	_size--;
+}
@@ -0,0 +1,84 @@
+#ifndef ROSA_CACHE_TABLE_HH
+#define ROSA_CACHE_TABLE_HH
+
+#include "duration.hh"
+
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+struct CacheStatistics {
+	std::size_t size{0};
+	std::size_t capacity{0};
+	std::size_t memory_usage{0};
+
+	uint64_t hits{0};
+	uint64_t misses{0};
+	uint64_t evictions{0};
+
+	auto operator+=(const CacheStatistics & other) -> CacheStatistics &;
+};
+
+/*
+ * An open-addressing hash table from 128-bit state keys to cached results,
+ * using linear probing. Each slot is 24 bytes: the two key words, the value
+ * and the frames, which are stored as 32 bits as no route comes close to the
+ * nine hours that would overflow them. Lookups and insertions each make a
+ * single pass over the probe sequence.
+ *
+ * The table may be limited to a number of bytes, which includes the old slots
+ * while it grows, and to a number of entries. Once it can grow no further,
+ * each insertion evicts an entry chosen by a weighted CLOCK policy: every use
+ * of an entry gives it a weight based on the cost of solving it again, and a
+ * hand sweeps over the slots, decrementing the weights it passes and evicting
+ * the first entry whose weight has run out.
+ */
+class CacheTable {
+	public:
+		static constexpr int32_t EMPTY = INT32_MIN;
+
+		struct Entry {
+			uint64_t key1{0};
+			uint64_t key2{0};
+			int32_t value{EMPTY};
+			int32_t frames{0};
+		};
+
+		explicit CacheTable(std::size_t memory_limit = 0, std::size_t maximum_size = std::numeric_limits<std::size_t>::max());
+
+		[[nodiscard]] auto get(const std::pair<uint64_t, uint64_t> & keys) -> std::pair<int, Milliframes>;
+		void set(const std::pair<uint64_t, uint64_t> & keys, int value, Milliframes frames);
+		void prefetch(const std::pair<uint64_t, uint64_t> & keys) const;
+
+		void get_entries(std::vector<Entry> * entries) const;
+		void insert(const Entry & entry);
+
+		[[nodiscard]] auto get_size() const -> std::size_t;
+		[[nodiscard]] auto get_statistics() const -> CacheStatistics;
+
+		static auto get_hash(const std::pair<uint64_t, uint64_t> & keys) -> uint64_t;
+
+	private:
+		[[nodiscard]] auto _find(const std::pair<uint64_t, uint64_t> & keys) const -> std::size_t;
+		auto _grow() -> bool;
+		void _evict();
+		void _erase(std::size_t index);
+
+		auto _get_weight(Milliframes frames) -> uint8_t;
+
+		std::vector<Entry> _entries;
+		std::vector<uint8_t> _weights;
+		std::size_t _size{0};
+
+		const std::size_t _memory_limit;
+		const std::size_t _maximum_size;
+		std::size_t _hand{0};
+		uint64_t _maximum_frames{0};
+
+		uint64_t _hits{0};
+		uint64_t _misses{0};
+		uint64_t _evictions{0};
+};
+
+#endif // ROSA_CACHE_TABLE_HH
@@ -0,0 +1,144 @@
+#include "checkpoint.hh"
+
+#include <boost/algorithm/string/join.hpp>
+#include <boost/format.hpp>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+constexpr std::array<char, 8> CHECKPOINT_MAGIC{'R', 'O', 'S', 'A', 'C', 'K', 'P', 'T'};
+constexpr uint32_t CHECKPOINT_VERSION = 1;
+constexpr uint32_t CHECKPOINT_POLL_INTERVAL = 65536;
+constexpr double BYTES_PER_MEBIBYTE = 1024.0 * 1024.0;
+
+using Clock = std::chrono::steady_clock;
+
+Checkpoint::Checkpoint(std::string filename, const CacheMetadata & metadata, std::chrono::seconds interval) :
+		_filename{std::move(filename)},
+		_metadata{metadata},
+		_interval{interval},
+		_next{(Clock::now() + _interval).time_since_epoch().count()} { }
+
+Checkpoint::~Checkpoint() {
+	if (_writer.joinable()) {
+		_writer.join();
+	}
+}
+
+/*
+ * Starts a checkpoint if one is due. This is called after every cache update,
+ * so each thread only looks at the clock once every few thousand calls.
+ */
+void Checkpoint::poll(const Cache & cache) {
+	thread_local uint32_t calls{0};
+
+	if (++calls < CHECKPOINT_POLL_INTERVAL) {
+		return;
+	}
+
+	calls = 0;
+
+	auto start{Clock::now()};
+
+	if (start.time_since_epoch().count() < _next.load(std::memory_order_relaxed)) {
+		return;
+	}
+
+	// Another thread may already be copying the cache, or the previous
+	// checkpoint may still be being written, in which case this one waits.
+	std::unique_lock<std::mutex> lock{_mutex, std::try_to_lock};
+
+	if (!lock.owns_lock() || _writing.load(std::memory_order_acquire)) {
+		return;
+	}
+
+	if (_writer.joinable()) {
+		_writer.join();
+	}
+
+	std::vector<CacheTable::Entry> entries;
+	cache.get_entries(&entries);
+
+	auto copy_time{Clock::now() - start};
+
+	_next.store((start + _interval).time_since_epoch().count(), std::memory_order_relaxed);
+	_writing.store(true, std::memory_order_release);
+
+	_writer = std::thread{[this, entries{std::move(entries)}, copy_time]() mutable {
+		_write(std::move(entries), copy_time);
+		_writing.store(false, std::memory_order_release);
+	}};
+}
+
+/*
+ * Reads the entries of the snapshot at the given location, refusing it if it
+ * was written for a run with different metadata.
+ */
+auto Checkpoint::load(const std::string & filename, const CacheMetadata & metadata) -> std::vector<CacheTable::Entry> {
+	std::ifstream file{filename, std::ios_base::in | std::ios_base::binary};
+	Header header;
+
+	file.read(reinterpret_cast<char *>(&header), sizeof(header)); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+
+	if (!file || header.magic != CHECKPOINT_MAGIC || header.version != CHECKPOINT_VERSION || header.entry_size != sizeof(CacheTable::Entry)) {
+		throw CacheError{"The file at " + filename + " is not a checkpoint in a format this version of Rosa can read. Delete it or use a different checkpoint location."};
+	}
+
+	auto differences{header.metadata.get_differences(metadata)};
+
+	if (!differences.empty()) {
+		throw CacheError{"The checkpoint at " + filename + " does not match this run: " + boost::algorithm::join(differences, ", ") + ". Delete it or use a different checkpoint location."};
+	}
+
+	std::vector<CacheTable::Entry> entries(header.count);
+	file.read(reinterpret_cast<char *>(entries.data()), static_cast<std::streamsize>(entries.size() * sizeof(CacheTable::Entry))); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+
+	if (!file) {
+		throw CacheError{"The checkpoint at " + filename + " is truncated. Delete it or use a different checkpoint location."};
+	}
+
+	return entries;
+}
+
+/*
+ * Runs on the writer thread. The entries are sorted by key so that snapshots
+ * of similar caches are similar files.
+ */
+void Checkpoint::_write(std::vector<CacheTable::Entry> entries, Clock::duration copy_time) {
+	auto start{Clock::now()};
+
+	std::sort(entries.begin(), entries.end(), [](const auto & first, const auto & second) {
+		return std::make_pair(first.key1, first.key2) < std::make_pair(second.key1, second.key2);
+	});
+
+	Header header{CHECKPOINT_MAGIC, CHECKPOINT_VERSION, sizeof(CacheTable::Entry), entries.size(), _metadata};
+	auto temporary_filename{_filename + ".tmp"};
+
+	{
+		std::ofstream file{temporary_filename, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc};
+
+		file.write(reinterpret_cast<const char *>(&header), sizeof(header)); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+		file.write(reinterpret_cast<const char *>(entries.data()), static_cast<std::streamsize>(entries.size() * sizeof(CacheTable::Entry))); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+		file.close();
+
+		if (!file) {
+			std::cerr << "ERROR: Failed to write the checkpoint to " << temporary_filename << '\n';
+			return;
+		}
+	}
+
+	std::error_code error;
+	std::filesystem::rename(temporary_filename, _filename, error);
+
+	if (error) {
+		std::cerr << "ERROR: Failed to replace the checkpoint at " << _filename << ": " << error.message() << '\n';
+		return;
+	}
+
+	auto size{static_cast<double>(sizeof(Header) + entries.size() * sizeof(CacheTable::Entry)) / BYTES_PER_MEBIBYTE};
+	auto write_time{std::chrono::duration<double>(Clock::now() - start).count()};
+
+	std::cerr << boost::format("Checkpoint: %d entries, %0.1f MiB, copied in %0.3fs and written in %0.3fs\n") % entries.size() % size % std::chrono::duration<double>(copy_time).count() % write_time;
+}
@@ -0,0 +1,60 @@
+#ifndef ROSA_CHECKPOINT_HH
+#define ROSA_CHECKPOINT_HH
+
+#include "cache.hh"
+#include "cache_metadata.hh"
+#include "cache_table.hh"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Periodically saves the contents of an in-memory cache to a snapshot file, so
+ * that a run that is killed can be resumed from its last checkpoint. When a
+ * checkpoint is due, the cache is copied by whichever optimizing thread notices
+ * first, and the copy is sorted and written by a background thread while
+ * optimization continues. Each snapshot is written beside the previous one and
+ * renamed over it once complete, so an interrupted write never loses it.
+ */
+class Checkpoint {
+	public:
+		Checkpoint(std::string filename, const CacheMetadata & metadata, std::chrono::seconds interval);
+		Checkpoint(const Checkpoint &) = delete;
+		Checkpoint(const Checkpoint &&) = delete;
+		auto operator=(const Checkpoint &) -> Checkpoint & = delete;
+		auto operator=(const Checkpoint &&) -> Checkpoint & = delete;
+
+		~Checkpoint();
+
+		void poll(const Cache & cache);
+
+		static auto load(const std::string & filename, const CacheMetadata & metadata) -> std::vector<CacheTable::Entry>;
+
+	private:
+		struct Header {
+			std::array<char, 8> magic{};
+			uint32_t version{0};
+			uint32_t entry_size{0};
+			uint64_t count{0};
+			CacheMetadata metadata{};
+		};
+
+		void _write(std::vector<CacheTable::Entry> entries, std::chrono::steady_clock::duration copy_time);
+
+		const std::string _filename;
+		const CacheMetadata _metadata;
+		const std::chrono::steady_clock::duration _interval;
+
+		std::atomic<std::chrono::steady_clock::rep> _next;
+		std::atomic<bool> _writing{false};
+		std::mutex _mutex{};
+		std::thread _writer{};
+};
+
+#endif // ROSA_CHECKPOINT_HH
@@ -0,0 +1,175 @@
+#include "compiled_route.hh"
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <string>
+#include <utility>
+
+CompiledRoute::CompiledRoute(const Route & route, const Maps & maps, Parties * parties) {
+	std::vector<std::vector<std::size_t>> choice_options(route.size());
+	std::vector<std::size_t> open_choices;
+
+	// Tracks, in route order, which parties may be active at each PATH so that
+	// only the encounter data those parties can use needs to be checked. Each
+	// option of a CHOICE starts from the parties active at the CHOICE, and any
+	// party active at the end of any option may be active after the END.
+	struct PartyScope {
+		std::set<uint16_t> entry_parties;
+		std::set<uint16_t> entry_searches;
+		std::set<uint16_t> exit_parties;
+		std::set<uint16_t> exit_searches;
+	};
+
+	std::set<uint16_t> active_parties{0};
+	std::set<uint16_t> search_parties;
+	std::vector<PartyScope> party_scopes;
+
+	for (std::size_t index = 0; index < route.size(); index++) {
+		const auto & instruction{route[index]};
+		CompiledInstruction result;
+
+		result.type = instruction.type;
+		result.variable = instruction.variable;
+		result.number = instruction.number;
+
+		switch (instruction.type) {
+			case InstructionType::Choice:
+				result.frames = instruction.transition_count * FRAMES_PER_TRANSITION;
+				open_choices.push_back(index);
+				party_scopes.push_back({active_parties, search_parties, {}, {}});
+				break;
+			case InstructionType::Delay:
+				result.frames = Frames{instruction.number};
+				break;
+			case InstructionType::End:
+				if (open_choices.empty()) {
+					std::cerr << "WARNING: END without a matching CHOICE at instruction " << index << '\n';
+				} else {
+					for (const auto & option : choice_options[open_choices.back()]) {
+						_instructions[option].target = index;
+					}
+
+					open_choices.pop_back();
+
+					auto & scope{party_scopes.back()};
+					scope.exit_parties.insert(active_parties.begin(), active_parties.end());
+					scope.exit_searches.insert(search_parties.begin(), search_parties.end());
+					active_parties = std::move(scope.exit_parties);
+					search_parties = std::move(scope.exit_searches);
+					party_scopes.pop_back();
+				}
+
+				break;
+			case InstructionType::Option:
+				if (open_choices.empty()) {
+					std::cerr << "WARNING: OPTION without a matching CHOICE at instruction " << index << '\n';
+				} else {
+					auto & scope{party_scopes.back()};
+
+					// Anything before the first option is never reached.
+					if (!choice_options[open_choices.back()].empty()) {
+						scope.exit_parties.insert(active_parties.begin(), active_parties.end());
+						scope.exit_searches.insert(search_parties.begin(), search_parties.end());
+					}
+
+					active_parties = scope.entry_parties;
+					search_parties = scope.entry_searches;
+					choice_options[open_choices.back()].push_back(index);
+				}
+
+				break;
+			case InstructionType::Party:
+				result.party = parties->add_party(instruction.text);
+				active_parties = {result.party};
+				break;
+			case InstructionType::Path: {
+				const auto & map{maps.get_map(instruction.map)};
+
+				result.tiles = instruction.tiles;
+				result.required_steps = instruction.required_steps;
+				result.optional_steps = instruction.optional_steps;
+				result.can_single_step = instruction.can_single_step;
+				result.can_double_step = instruction.can_double_step;
+				result.end_search = instruction.end_search;
+				result.encounter_rate = map.encounter_rate;
+				result.encounter_group = map.encounter_group;
+				result.frames = instruction.transition_count * FRAMES_PER_TRANSITION;
+				result.first_battle_penalty = instruction.first_battle_penalty;
+
+				if (map.encounter_rate > 0) {
+					auto group{std::find(_encounter_groups.begin(), _encounter_groups.end(), map.encounter_group)};
+					result.group_index = static_cast<std::size_t>(group - _encounter_groups.begin());
+
+					if (group == _encounter_groups.end()) {
+						_encounter_groups.push_back(map.encounter_group);
+					}
+
+					// The search may complete partway through this path.
+					active_parties.insert(search_parties.begin(), search_parties.end());
+
+					for (const auto & party : active_parties) {
+						_party_groups.emplace(party, result.group_index);
+					}
+				} else {
+					active_parties.insert(search_parties.begin(), search_parties.end());
+				}
+
+				if (instruction.end_search) {
+					search_parties.clear();
+				}
+
+				break;
+			}
+			case InstructionType::Search:
+				// Each target takes a bit of the found-target mask in the state.
+				if (instruction.numbers.size() > MAXIMUM_SEARCH_TARGETS) {
+					throw RouteError{"The SEARCH at instruction " + std::to_string(index) + " has " + std::to_string(instruction.numbers.size()) + " targets, but a search may have at most " + std::to_string(MAXIMUM_SEARCH_TARGETS)};
+				}
+
+				result.party = parties->add_party(instruction.party);
+				result.target = _searches.size();
+
+				_searches.emplace_back(instruction.expression.get(), instruction.numbers);
+				search_parties = {result.party};
+
+				break;
+			case InstructionType::Data:
+			case InstructionType::Note:
+			case InstructionType::Route:
+			case InstructionType::Save:
+			case InstructionType::Version:
+				break;
+		}
+
+		_instructions.push_back(result);
+	}
+
+	if (!open_choices.empty()) {
+		std::cerr << "WARNING: CHOICE without a matching END at instruction " << open_choices.back() << '\n';
+	}
+
+	for (std::size_t index = 0; index < route.size(); index++) {
+		if (_instructions[index].type == InstructionType::Choice) {
+			_instructions[index].target = _options.size();
+			_options.insert(_options.end(), choice_options[index].begin(), choice_options[index].end());
+		}
+	}
+}
+
+auto CompiledRoute::size() const -> std::size_t {
+	return _instructions.size();
+}
+
+auto CompiledRoute::get_option(const CompiledInstruction & instruction, int value) const -> std::size_t {
+	assert(value >= 0 && value < instruction.number && instruction.target + static_cast<std::size_t>(value) < _options.size());
+	return _options[instruction.target + static_cast<std::size_t>(value)];
+}
+
+auto CompiledRoute::get_encounter_groups() const -> const std::vector<int> & {
+	return _encounter_groups;
+}
+
+auto CompiledRoute::get_party_groups() const -> const std::set<std::pair<uint16_t, std::size_t>> & {
+	return _party_groups;
+}
@@ -0,0 +1,87 @@
+#ifndef ROSA_COMPILED_ROUTE_HH
+#define ROSA_COMPILED_ROUTE_HH
+
+#include "duration.hh"
+#include "instruction.hh"
+#include "map.hh"
+#include "party.hh"
+#include "search_automaton.hh"
+
+#include <cstdint>
+#include <set>
+#include <utility>
+#include <vector>
+
+constexpr auto FRAMES_PER_TRANSITION = 82_f;
+constexpr auto FRAMES_PER_TILE = 16_f;
+
+/*
+ * The parts of an instruction that the solver needs, with maps, parties and
+ * jump targets already resolved. Fields that do not apply to an instruction's
+ * type are left at their defaults.
+ */
+struct CompiledInstruction {
+	InstructionType type{InstructionType::Note};
+
+	int variable{-1};
+	int number{0};
+
+	int tiles{0};
+	int required_steps{0};
+	int optional_steps{0};
+
+	bool can_single_step{false};
+	bool can_double_step{false};
+	bool end_search{false};
+
+	int encounter_rate{0};
+	int encounter_group{0};
+	std::size_t group_index{0};
+
+	// The fixed cost of the instruction: transitions for a CHOICE or PATH, or
+	// the delay itself for a DELAY.
+	Milliframes frames{0};
+	Milliframes first_battle_penalty{0};
+
+	uint16_t party{0};
+
+	// For a CHOICE, the offset of its options in the option table. For an
+	// OPTION, the index of the END that closes its CHOICE. For a SEARCH, the
+	// index of its automaton.
+	std::size_t target{0};
+};
+
+/*
+ * An immutable form of a route, compiled once before optimization so that the
+ * inner loop of the solver never touches strings or hash maps.
+ */
+class CompiledRoute {
+	public:
+		CompiledRoute(const Route & route, const Maps & maps, Parties * parties);
+
+		[[nodiscard]] auto operator[](std::size_t index) const -> const CompiledInstruction & {
+			return _instructions[index];
+		}
+
+		[[nodiscard]] auto size() const -> std::size_t;
+
+		[[nodiscard]] auto get_option(const CompiledInstruction & instruction, int value) const -> std::size_t;
+
+		[[nodiscard]] auto get_search(const CompiledInstruction & instruction) const -> const SearchAutomaton & {
+			return _searches[instruction.target];
+		}
+
+		[[nodiscard]] auto get_encounter_groups() const -> const std::vector<int> &;
+		[[nodiscard]] auto get_party_groups() const -> const std::set<std::pair<uint16_t, std::size_t>> &;
+
+	private:
+		std::vector<CompiledInstruction> _instructions;
+
+		std::vector<std::size_t> _options;
+		std::vector<SearchAutomaton> _searches;
+
+		std::vector<int> _encounter_groups;
+		std::set<std::pair<uint16_t, std::size_t>> _party_groups;
+};
+
+#endif // ROSA_COMPILED_ROUTE_HH
@@ -5,11 +5,13 @@
 #include <boost/algorithm/string.hpp>
 #include <boost/algorithm/string/split.hpp>
 
+#include <algorithm>
 #include <iostream>
 
 using namespace std::chrono_literals;
 
 const int MAXIMUM_ENCOUNTERS = 512;
+const auto MISSING_PARTY_DURATION = std::chrono::duration_cast<Milliframes>(30s);
 
 Encounter::Encounter(std::size_t id, std::string description) : _id{id}, _description{std::move(description)} { }
 
@@ -25,15 +27,37 @@ void Encounter::add_duration(const Party & party, const Duration & duration) {
 	_durations[party] = duration;
 }
 
+auto Encounter::has_duration(const Party & party) const -> bool {
+	return _durations.count(party) > 0;
+}
+
+/*
+ * Returns the duration for the given party, or 30 seconds if the party is
+ * missing from the data. Callers are expected to check has_duration() and
+ * report any missing parties themselves.
+ */
 auto Encounter::get_duration(const Party & party, bool minimum) const -> Milliframes {
 	if (_durations.count(party) == 0) {
-		std::cerr << "WARNING: Party '" << party << "' not found for encounter " << _id << "... assuming 30 seconds\n";
-		return std::chrono::duration_cast<Milliframes>(30s);
+		return MISSING_PARTY_DURATION;
 	}
 
 	return minimum ? _durations.at(party).minimum : _durations.at(party).average;
 }
 
+/*
+ * Returns a duration no longer than this encounter takes for any party,
+ * including parties that are missing from the data.
+ */
+auto Encounter::get_shortest_duration(bool minimum) const -> Milliframes {
+	auto result{MISSING_PARTY_DURATION};
+
+	for (const auto & [party, duration] : _durations) {
+		result = std::min(result, minimum ? duration.minimum : duration.average);
+	}
+
+	return result;
+}
+
 Encounters::Encounters(std::istream & input) : _encounters{MAXIMUM_ENCOUNTERS}, _encounter_groups{MAXIMUM_ENCOUNTERS} {
 	std::string line;
 
@@ -16,7 +16,9 @@ class Encounter {
 		auto get_description() const -> std::string;
 
 		void add_duration(const Party & party, const Duration & duration);
+		[[nodiscard]] auto has_duration(const Party & party) const -> bool;
 		auto get_duration(const Party & party, bool minimum) const -> Milliframes;
+		[[nodiscard]] auto get_shortest_duration(bool minimum) const -> Milliframes;
 
 	private:
 		const std::size_t _id;
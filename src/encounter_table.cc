@@ -0,0 +1,42 @@
+#include "encounter_table.hh"
+
+#include <iostream>
+
+EncounterTable::EncounterTable(const Encounters & encounters, const Parties & parties, const std::vector<int> & groups, const std::set<std::pair<uint16_t, std::size_t>> & party_groups) : _group_count{groups.size()} {
+	_slots.resize(parties.get_size() * _group_count * ENCOUNTER_GROUP_SIZE);
+
+	for (std::size_t group_index = 0; group_index < _group_count; group_index++) {
+		for (std::size_t slot = 0; slot < ENCOUNTER_GROUP_SIZE; slot++) {
+			auto encounter{encounters.get_encounter_from_group(static_cast<std::size_t>(groups[group_index]), slot)};
+
+			if (!encounter) {
+				continue;
+			}
+
+			for (std::size_t party = 0; party < parties.get_size(); party++) {
+				auto & result{_slots[(party * _group_count + group_index) * ENCOUNTER_GROUP_SIZE + slot]};
+				const auto & party_data{parties.get_party(static_cast<uint16_t>(party))};
+
+				result.id = encounter->get_id();
+				result.average = encounter->get_duration(party_data, false);
+				result.minimum = encounter->get_duration(party_data, true);
+			}
+		}
+	}
+
+	std::set<std::pair<uint16_t, std::size_t>> missing;
+
+	for (const auto & [party, group_index] : party_groups) {
+		for (std::size_t slot = 0; slot < ENCOUNTER_GROUP_SIZE; slot++) {
+			auto encounter{encounters.get_encounter_from_group(static_cast<std::size_t>(groups[group_index]), slot)};
+
+			if (encounter && !encounter->has_duration(parties.get_party(party)) && missing.emplace(party, encounter->get_id()).second) {
+				std::cerr << "WARNING: Party '" << parties.get_party(party) << "' not found for encounter " << encounter->get_id() << "... assuming 30 seconds\n";
+			}
+		}
+	}
+}
+
+auto EncounterTable::get_slot(uint16_t party, std::size_t group_index, std::size_t slot) const -> const EncounterSlot & {
+	return _slots[(party * _group_count + group_index) * ENCOUNTER_GROUP_SIZE + slot];
+}
@@ -0,0 +1,42 @@
+#ifndef ROSA_ENCOUNTER_TABLE_HH
+#define ROSA_ENCOUNTER_TABLE_HH
+
+#include "duration.hh"
+#include "encounter.hh"
+#include "party.hh"
+
+#include <cstdint>
+#include <set>
+#include <utility>
+#include <vector>
+
+constexpr std::size_t ENCOUNTER_GROUP_SIZE = 8;
+
+struct EncounterSlot {
+	std::size_t id{0};
+	Milliframes average{0};
+	Milliframes minimum{0};
+};
+
+/*
+ * A dense, read-only copy of the encounter data needed by a route. For every
+ * interned party and every encounter group the route visits, it holds the
+ * encounter ID and durations for each of the eight slots in the group. Groups
+ * are referred to by their index in the given list. Missing durations are
+ * reported once, for the party and group pairs that the route may actually
+ * combine.
+ */
+class EncounterTable {
+	public:
+		EncounterTable() = default;
+		EncounterTable(const Encounters & encounters, const Parties & parties, const std::vector<int> & groups, const std::set<std::pair<uint16_t, std::size_t>> & party_groups);
+
+		[[nodiscard]] auto get_slot(uint16_t party, std::size_t group_index, std::size_t slot) const -> const EncounterSlot &;
+
+	private:
+		std::size_t _group_count{0};
+
+		std::vector<EncounterSlot> _slots;
+};
+
+#endif // ROSA_ENCOUNTER_TABLE_HH
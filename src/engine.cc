@@ -1,17 +1,62 @@
+#include <algorithm>
+#include <filesystem>
 #include <iostream>
-#include <numeric>
+#include <limits>
+#include <map>
+#include <set>
 
 #include <boost/format.hpp>
+#include <boost/functional/hash.hpp>
 #include <boost/range/adaptor/indexed.hpp>
 
-#include "peglib.h"
+#include <tsl/sparse_set.h>
 
 #include "engine.hh"
+#include "rng.hh"
 #include "version.hh"
 
-constexpr int SEED_UPDATE_DELTA = 17;
-constexpr auto FRAMES_PER_TRANSITION = 82_f;
-constexpr auto FRAMES_PER_TILE = 16_f;
+constexpr std::size_t CACHE_SHARDS_PER_THREAD = 16;
+constexpr std::size_t FRONTIER_BATCH_SIZE = 256;
+constexpr uint32_t EVICTION_POLL_INTERVAL = 4096;
+constexpr std::size_t BOUND_CACHE_DIVISOR = 8;
+constexpr double EVICTION_WARNING_RATIO = 0.9;
+constexpr uint64_t EVICTION_WARNING_TURNOVER = 4;
+constexpr std::size_t PREFETCH_DISTANCE = 8;
+constexpr double BYTES_PER_MEBIBYTE = 1024.0 * 1024.0;
+
+/*
+ * Returns the given text as a quoted JSON string.
+ */
+auto json_string(const std::string & text) -> std::string {
+	std::string output{"\""};
+
+	for (const auto & c : text) {
+		switch (c) {
+			case '"':
+				output += "\\\"";
+				break;
+			case '\\':
+				output += "\\\\";
+				break;
+			case '\n':
+				output += "\\n";
+				break;
+			case '\t':
+				output += "\\t";
+				break;
+			default:
+				if (static_cast<unsigned char>(c) < 0x20) { // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+					output += (boost::format("\\u%04x") % static_cast<int>(c)).str();
+				} else {
+					output += c;
+				}
+
+				break;
+		}
+	}
+
+	return output + "\"";
+}
 
 auto search_expression_next_token(const std::string & expression, std::size_t & index) -> std::string {
 	while (expression.at(index) == ' ') {
@@ -29,17 +74,109 @@ auto search_expression_next_token(const std::string & expression, std::size_t &
 	return expression.substr(original_index, length);
 }
 
-Engine::Engine(Parameters parameters) : _parameters{std::move(parameters)} {
-	switch (parameters.cache_type) {
+Engine::Engine(Parameters parameters) :
+		_parameters{std::move(parameters)},
+		_route{_parameters.route, _parameters.maps, &_parties},
+		_encounter_table{_parameters.encounters, _parties, _route.get_encounter_groups(), _route.get_party_groups()} {
+	auto threads{static_cast<std::size_t>(std::max(_parameters.threads, 1))};
+
+	if (_parameters.cache_type != CacheType::Dynamic && threads > 1) {
+		std::cerr << "WARNING: Only the dynamic cache supports multiple threads... using one thread\n";
+		threads = 1;
+	}
+
+	_memory_limit = _parameters.memory_limit;
+
+	// The mapped cache leaves its memory use to the kernel's page cache.
+	if (_memory_limit > 0 && (_parameters.cache_type == CacheType::Mapped || _parameters.cache_type == CacheType::Shared)) {
+		std::cerr << "WARNING: The memory limit does not apply to the mapped cache\n";
+		_memory_limit = 0;
+	}
+
+	// The frontier engine reads the results of successors from the cache, so
+	// it has no way to recompute them if they are evicted.
+	if (_memory_limit > 0 && _parameters.engine_type != EngineType::Recursive) {
+		std::cerr << "WARNING: The memory limit is only supported by the recursive engine\n";
+		_memory_limit = 0;
+	}
+
+	// The lower bounds found while pruning are kept in a cache of their own,
+	// which is given a share of the limit so that both stay within it.
+	if (_memory_limit > 0 && _parameters.prune) {
+		_bound_memory_limit = _memory_limit / BOUND_CACHE_DIVISOR;
+		_memory_limit -= _bound_memory_limit;
+	}
+
+	switch (_parameters.cache_type) {
 		case CacheType::Dynamic:
-			_cache = std::make_unique<DynamicCache>();
+			if (threads > 1) {
+				_cache = std::make_unique<ConcurrentCache>(threads * CACHE_SHARDS_PER_THREAD, _memory_limit);
+			} else {
+				_cache = std::make_unique<DynamicCache>(_memory_limit);
+			}
+
 			break;
 		case CacheType::Persistent:
-			_cache = std::make_unique<PersistentCache>(_parameters.cache_location, _parameters.cache_size);
+			_cache = std::make_unique<PersistentCache>(_parameters.cache_location, _parameters.cache_metadata, _parameters.cache_size, _memory_limit, _parameters.cache_map_size);
 			break;
+		case CacheType::Mapped:
+			_cache = std::make_unique<MappedCache>(_parameters.cache_location, _parameters.cache_metadata);
+			break;
+		case CacheType::Shared:
+			_cache = std::make_unique<MappedCache>(_parameters.cache_location, _parameters.cache_metadata, _parameters.shared_cache_size);
+			break;
+	}
+
+	if (!_parameters.checkpoint_filename.empty()) {
+		if (_parameters.cache_type != CacheType::Dynamic) {
+			std::cerr << "WARNING: Checkpoints are only supported by the dynamic cache\n";
+		} else {
+			if (_parameters.resume) {
+				if (std::filesystem::exists(_parameters.checkpoint_filename)) {
+					auto entries{Checkpoint::load(_parameters.checkpoint_filename, _parameters.cache_metadata)};
+					_cache->insert(entries);
+
+					std::cerr << boost::format("Resuming from a checkpoint with %d entries...\n") % entries.size();
+				} else {
+					std::cerr << "WARNING: No checkpoint was found at " << _parameters.checkpoint_filename << "... starting from the beginning\n";
+				}
+			}
+
+			_checkpoint = std::make_unique<Checkpoint>(_parameters.checkpoint_filename, _parameters.cache_metadata, _parameters.checkpoint_interval);
+		}
+	} else if (_parameters.resume) {
+		std::cerr << "WARNING: Resuming requires a checkpoint location\n";
+	}
+
+	if (threads > 1) {
+		_pool = std::make_unique<ThreadPool>(threads);
+	}
+
+	if (_parameters.prune && _parameters.engine_type != EngineType::Recursive) {
+		std::cerr << "WARNING: Pruning is only supported by the recursive engine\n";
+	}
+
+	if (_parameters.prune) {
+		_bound_cache = _create_bound_cache();
+	}
+
+	if (_parameters.decision_cache && _parameters.engine_type != EngineType::Recursive) {
+		std::cerr << "WARNING: The decision cache is only supported by the recursive engine\n";
+	}
+
+	for (std::size_t index = 0; index < _route.size(); index++) {
+		if (_route[index].type == InstructionType::Path) {
+			_step_tables.add(_route[index].encounter_rate);
+		}
 	}
 
 	for (const auto & instruction : _parameters.route) {
+		if (instruction.type == InstructionType::Route) {
+			_route_title = instruction.text;
+		} else if (instruction.type == InstructionType::Version) {
+			_route_version = instruction.number;
+		}
+
 		if (instruction.variable >= 0) {
 			if (_variables.count(instruction.variable) == 0) {
 				switch (instruction.type) {
@@ -64,18 +201,69 @@ Engine::Engine(Parameters parameters) : _parameters{std::move(parameters)} {
 			}
 		}
 	}
+
+	// With the decision cache, states are only cached where a choice is made
+	// or where the options of a choice rejoin.
+	bool decision_cache{_parameters.decision_cache && _parameters.engine_type == EngineType::Recursive};
+
+	for (std::size_t index = 0; index < _route.size(); index++) {
+		auto variable{_route[index].variable};
+		_instruction_variables.push_back(variable > 0 ? &_variables.at(variable) : nullptr);
+		_cache_points.push_back(!decision_cache || variable > 0 || _route[index].type == InstructionType::End);
+	}
+
+	if (_parameters.suffix_keys) {
+		_compute_suffix_hashes();
+	}
+
+	_compute_scopes();
 }
 
 void Engine::set_variable_minimum(int variable, int value) {
 	_variables[variable].minimum = value;
+	_constrained_variables.insert(variable);
+	_compute_scopes();
 }
 
 void Engine::set_variable_maximum(int variable, int value) {
 	_variables[variable].maximum = value;
+	_constrained_variables.insert(variable);
+	_compute_scopes();
+}
+
+void Engine::set_incumbent(const std::unordered_map<int, int> & variables, Milliframes frames) {
+	_incumbent = std::make_pair(variables, frames);
+}
+
+/*
+ * Returns the statistics of the cache, together with those of the lower bounds
+ * kept while pruning, so that the memory reported covers both.
+ */
+auto Engine::get_cache_statistics() const -> CacheStatistics {
+	auto statistics{_cache->get_statistics()};
+
+	if (_bound_cache) {
+		statistics += _bound_cache->get_statistics();
+	}
+
+	return statistics;
+}
+
+/*
+ * Creates the in-memory cache of lower bounds found while pruning. These are
+ * only valid for this run, so they are never kept with the other results.
+ */
+auto Engine::_create_bound_cache() const -> std::unique_ptr<Cache> {
+	if (_pool) {
+		return std::make_unique<ConcurrentCache>(_pool->get_size() * CACHE_SHARDS_PER_THREAD, _bound_memory_limit);
+	}
+
+	return std::make_unique<DynamicCache>(_bound_memory_limit);
 }
 
 auto Engine::optimize(int seed) -> std::string {
 	State state{seed};
+	state.location = _get_location(state);
 
 	int minimum_step_segments{-1};
 
@@ -90,12 +278,36 @@ auto Engine::optimize(int seed) -> std::string {
 	Milliframes best_result{Milliframes::max()};
 	int best_step_segments{-1};
 
+	// States do not depend on the starting seed, so a cache that is already
+	// populated by earlier seeds is reused as is, and only the statistics for
+	// this seed are reported.
+	auto initial_statistics{_cache->get_statistics()};
+	_pruned_candidates = 0;
+	_solved_states = 0;
+	_resolved_states = 0;
+	_initial_evictions = initial_statistics.evictions;
+	_eviction_warning = false;
+
+	if (_parameters.prune && _lower_bounds.empty()) {
+		_compute_lower_bounds();
+	}
+
 	for (auto i{minimum_step_segments}; i <= _parameters.maximum_step_segments; i++) {
 		if (i >= 0) {
 			state.remaining_segments = static_cast<uint16_t>(i);
 		}
 
-		auto result{_optimize(state)};
+		auto bound{Milliframes::max()};
+
+		// Only a strictly better result can replace the current best, so the
+		// best result so far is itself a valid bound for the search. The first
+		// pass is bounded by the incumbent instead, and its result can be no
+		// worse, so the incumbent is only needed once.
+		if (_parameters.prune) {
+			bound = i == minimum_step_segments ? _get_incumbent(state) + 1_mf : best_result;
+		}
+
+		auto result{_solve(state, bound)};
 
 		if (result < best_result) {
 			best_result = result;
@@ -107,17 +319,281 @@ auto Engine::optimize(int seed) -> std::string {
 		state.remaining_segments = static_cast<uint16_t>(best_step_segments);
 	}
 
+	if (_parameters.prune) {
+		std::cerr << boost::format("Pruning: %d candidates skipped, %d states solved\n") % _pruned_candidates % _solved_states;
+	}
+
 	auto log{_finalize(state)};
 
+	if (_parameters.verbose) {
+		auto statistics{_cache->get_statistics()};
+		auto hits{statistics.hits - initial_statistics.hits};
+		auto misses{statistics.misses - initial_statistics.misses};
+		auto load{static_cast<double>(statistics.size) / static_cast<double>(std::max(statistics.capacity, static_cast<std::size_t>(1)))};
+		auto hit_rate{static_cast<double>(hits) / static_cast<double>(std::max(hits + misses, static_cast<uint64_t>(1)))};
+
+		std::cerr << boost::format("Cache: %d entries, %0.1f%% load, %0.1f MiB\n") % statistics.size % (load * 100.0) % (static_cast<double>(statistics.memory_usage) / BYTES_PER_MEBIBYTE); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+		std::cerr << boost::format("Cache: %0.1f%% hit rate, %d evictions, %d states solved again for the output\n") % (hit_rate * 100.0) % (statistics.evictions - initial_statistics.evictions) % _resolved_states; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+
+		if (initial_statistics.size > 0) {
+			std::cerr << boost::format("Cache: %d entries added to the %d already cached\n") % (statistics.size - std::min(statistics.size, initial_statistics.size)) % initial_statistics.size;
+		}
+
+		if (_bound_cache) {
+			auto bound_statistics{_bound_cache->get_statistics()};
+			std::cerr << boost::format("Bounds: %d entries, %0.1f MiB, %d evictions\n") % bound_statistics.size % (static_cast<double>(bound_statistics.memory_usage) / BYTES_PER_MEBIBYTE) % bound_statistics.evictions;
+		}
+	}
+
+	switch (_parameters.output_format) {
+		case OutputFormat::Text:
+			break;
+		case OutputFormat::Json:
+			return _generate_output_json(state, log, false);
+		case OutputFormat::Ndjson:
+			return _generate_output_json(state, log, true);
+	}
+
 	return _generate_output_text(state, log);
 }
 
+auto Engine::count_states(int seed) -> std::string {
+	State state{seed};
+	state.location = _get_location(state);
+
+	if (_parameters.maximum_step_segments >= 0) {
+		state.remaining_segments = static_cast<uint16_t>(_parameters.maximum_step_segments);
+	}
+
+	auto frontiers{_expand_frontiers(state)};
+
+	std::string output;
+	std::size_t total{0};
+
+	for (const auto & [index, frontier] : frontiers | boost::adaptors::indexed(0)) {
+		if (!frontier.empty()) {
+			output += (boost::format("INDEX\t%d\t%d\n") % index % frontier.size()).str();
+			total += frontier.size();
+		}
+	}
+
+	output += (boost::format("TOTAL\t%d\n") % total).str();
+
+	return output;
+}
+
+/*
+ * Returns a description of the first given value that the route cannot use, or
+ * an empty string if there is none. A CHOICE takes the index of one of its
+ * options, and a PATH any number of extra steps.
+ */
+auto Engine::get_variable_error(const std::unordered_map<int, int> & variables) const -> std::string {
+	std::map<int, int> sorted_variables{variables.begin(), variables.end()};
+
+	for (const auto & [key, value] : sorted_variables) {
+		auto name{(boost::format("%07X") % key).str()};
+		auto variable{_variables.find(key)};
+
+		if (variable == _variables.end()) {
+			return "Unknown variable " + name;
+		}
+
+		switch (variable->second.type) {
+			case VariableType::Choice:
+				for (std::size_t index = 0; index < _route.size(); index++) {
+					const auto & instruction{_route[index]};
+
+					if (instruction.type == InstructionType::Choice && instruction.variable == key && (value < 0 || value >= instruction.number)) {
+						return (boost::format("Invalid value %d for %s, which has %d options") % value % name % instruction.number).str();
+					}
+				}
+
+				break;
+			case VariableType::Step:
+				if (value < 0) {
+					return (boost::format("Invalid value %d for %s, which cannot take fewer than zero extra steps") % value % name).str();
+				}
+
+				break;
+		}
+	}
+
+	return "";
+}
+
+/*
+ * Replays the route with every variable fixed for each seed in the range,
+ * which takes far less time than optimizing even a single seed. The seeds are
+ * split between threads if there are several.
+ */
+auto Engine::evaluate(int first_seed, int last_seed, const std::unordered_map<int, int> & variables) -> std::string {
+	std::vector<std::pair<Milliframes, int>> results(static_cast<std::size_t>(last_seed - first_seed + 1));
+
+	parallel_for(_pool.get(), results.size(), 1, [this, first_seed, &variables, &results](std::size_t begin, std::size_t end) {
+		for (auto i{begin}; i < end; i++) {
+			State state{first_seed + static_cast<int>(i)};
+			state.location = _get_location(state);
+
+			if (_parameters.maximum_step_segments >= 0) {
+				state.remaining_segments = static_cast<uint16_t>(_parameters.maximum_step_segments);
+			}
+
+			results[i] = _evaluate(state, variables);
+		}
+	});
+
+	switch (_parameters.output_format) {
+		case OutputFormat::Text:
+			break;
+		case OutputFormat::Json:
+			return _generate_evaluation_json(first_seed, variables, results, false);
+		case OutputFormat::Ndjson:
+			return _generate_evaluation_json(first_seed, variables, results, true);
+	}
+
+	return _generate_evaluation_text(first_seed, results);
+}
+
+auto Engine::_generate_evaluation_text(int first_seed, const std::vector<std::pair<Milliframes, int>> & results) -> std::string {
+	std::string output;
+	Milliframes total_frames{0};
+	int total_encounters{0};
+	std::size_t best{0};
+	std::size_t worst{0};
+
+	for (const auto & [i, result] : results | boost::adaptors::indexed(0)) {
+		auto index{static_cast<std::size_t>(i)};
+
+		output += (boost::format("SEED\t%d\t%d\t%d\n") % (first_seed + i) % result.first.count() % result.second).str();
+
+		total_frames += result.first;
+		total_encounters += result.second;
+
+		if (result.first < results[best].first) {
+			best = index;
+		}
+
+		if (result.first > results[worst].first) {
+			worst = index;
+		}
+	}
+
+	auto count{static_cast<double>(results.size())};
+
+	output += '\n';
+	output += (boost::format("%-21s%0.3fs\n") % "Mean Total Time:" % (Seconds(total_frames).count() / count)).str();
+	output += (boost::format("%-21s%0.3fs (seed %d)\n") % "Best Total Time:" % Seconds(results[best].first).count() % (first_seed + static_cast<int>(best))).str();
+	output += (boost::format("%-21s%0.3fs (seed %d)\n") % "Worst Total Time:" % Seconds(results[worst].first).count() % (first_seed + static_cast<int>(worst))).str();
+	output += (boost::format("%-21s%0.1f\n") % "Mean Encounters:" % (total_encounters / count)).str();
+
+	return output;
+}
+
+/*
+ * Generates the evaluation as a JSON object holding the route, the evaluated
+ * variables and the frames and encounters for each seed, in milliframes like
+ * the routes themselves, followed by the same totals as the text form. In the
+ * compact form, used for NDJSON, each seed is instead written as its own
+ * object on a single line, and the totals are left to the reader.
+ */
+auto Engine::_generate_evaluation_json(int first_seed, const std::unordered_map<int, int> & variables, const std::vector<std::pair<Milliframes, int>> & results, bool compact) -> std::string {
+	auto field{[](const std::string & name, const std::string & value) {
+		return json_string(name) + ": " + value;
+	}};
+
+	std::string output;
+
+	if (compact) {
+		for (const auto & [i, result] : results | boost::adaptors::indexed(0)) {
+			output += (boost::format("{\"seed\":%d,\"frames\":%d,\"encounters\":%d}\n") % (first_seed + i) % result.first.count() % result.second).str();
+		}
+
+		return output;
+	}
+
+	std::map<int, int> sorted_variables{variables.begin(), variables.end()};
+	std::string variables_output;
+
+	for (const auto & [key, value] : sorted_variables) {
+		variables_output += (variables_output.empty() ? "" : ", ") + field((boost::format("%07X") % key).str(), std::to_string(value));
+	}
+
+	std::string seeds_output;
+	Milliframes total_frames{0};
+	int total_encounters{0};
+	std::size_t best{0};
+	std::size_t worst{0};
+
+	for (const auto & [i, result] : results | boost::adaptors::indexed(0)) {
+		auto index{static_cast<std::size_t>(i)};
+
+		seeds_output += (seeds_output.empty() ? "" : ",\n") + std::string{"\t\t{"};
+		seeds_output += field("seed", std::to_string(first_seed + i)) + ", ";
+		seeds_output += field("frames", std::to_string(result.first.count())) + ", ";
+		seeds_output += field("encounters", std::to_string(result.second)) + "}";
+
+		total_frames += result.first;
+		total_encounters += result.second;
+
+		if (result.first < results[best].first) {
+			best = index;
+		}
+
+		if (result.first > results[worst].first) {
+			worst = index;
+		}
+	}
+
+	auto count{static_cast<double>(results.size())};
+
+	output += "{\n";
+	output += "\t" + field("route", json_string(_route_title)) + ",\n";
+	output += "\t" + field("version", std::to_string(_route_version)) + ",\n";
+	output += "\t" + field("rosa", json_string(ROSA_VERSION)) + ",\n";
+	output += "\t" + field("variables", "{" + variables_output + "}") + ",\n";
+	output += "\t" + field("seeds", "[\n" + seeds_output + "\n\t]") + ",\n";
+	output += "\t" + field("totals", "{\n");
+	output += "\t\t" + field("mean_frames", (boost::format("%0.3f") % (static_cast<double>(total_frames.count()) / count)).str()) + ",\n";
+	output += "\t\t" + field("best_seed", std::to_string(first_seed + static_cast<int>(best))) + ",\n";
+	output += "\t\t" + field("worst_seed", std::to_string(first_seed + static_cast<int>(worst))) + ",\n";
+	output += "\t\t" + field("mean_encounters", (boost::format("%0.3f") % (total_encounters / count)).str()) + "\n";
+	output += "\t}\n";
+	output += "}\n";
+
+	return output;
+}
+
+auto Engine::_solve(const State & state, Milliframes bound) -> Milliframes {
+	switch (_parameters.engine_type) {
+		case EngineType::Recursive:
+			break;
+		case EngineType::Frontier:
+			return _optimize_frontier(state);
+	}
+
+	bool exact{true};
+	return _optimize(state, bound, &exact);
+}
+
 auto Engine::_finalize(State state) -> Log {
 	Log log;
 
-	while (state.index < _parameters.route.size()) {
-		auto instruction = _parameters.route[state.index];
-		auto [value, frames] = _cache->get(state);
+	for (auto & [key, variable] : _variables) {
+		variable.value = 0;
+	}
+
+	while (state.index < _route.size()) {
+		const auto & instruction{_route[state.index]};
+		auto value{_cache_points[state.index] ? _cache->get(state).first : _get_forced_value(state)};
+
+		// The state may have been evicted since it was solved.
+		if (value < 0 && _cache_points[state.index]) {
+			bool exact{true};
+			_optimize(state, Milliframes::max(), &exact);
+			_resolved_states++;
+
+			value = _cache->get(state).first;
+		}
 
 		if (value < 0) {
 			std::cerr << "BUG: _finalize() attempted to use uncached state...\n";
@@ -156,35 +632,27 @@ auto Engine::_generate_output_text(const State & state, const Log & log) -> std:
 	std::size_t indent_level{0};
 
 	for (const auto & entry : log) {
-		auto instruction{_parameters.route[entry.state.index]};
-		std::string description;
+		const auto & instruction{_parameters.route[entry.state.index]};
+		auto description{_get_description(entry)};
 		std::size_t new_indent_level{indent_level};
 
 		switch (instruction.type) {
 			case InstructionType::Path:
-				description = _parameters.maps.get_map(instruction.map).description;
-
 				if (instruction.end_search) {
 					new_indent_level--;
 				}
 
 				break;
 			case InstructionType::Choice:
-				description = entry.extra_text;
-				new_indent_level++;
-				break;
 			case InstructionType::Search:
-				description = instruction.text;
 				new_indent_level++;
 				break;
-			case InstructionType::Note:
-				description = instruction.text;
-				break;
 			case InstructionType::End:
 				new_indent_level--;
 				break;
 			case InstructionType::Data:
 			case InstructionType::Delay:
+			case InstructionType::Note:
 			case InstructionType::Option:
 			case InstructionType::Party:
 			case InstructionType::Route:
@@ -198,14 +666,7 @@ auto Engine::_generate_output_text(const State & state, const Log & log) -> std:
 		}
 
 		if (entry.steps > 0 || instruction.optional_steps > 0) {
-			auto steps{entry.steps - instruction.required_steps};
-			auto optional_steps{std::min(instruction.optional_steps, steps)};
-			auto extra_steps{steps - optional_steps};
-
-			if (extra_steps % 2 == 1 && optional_steps > 0) {
-				optional_steps--;
-				extra_steps++;
-			}
+			auto [optional_steps, extra_steps] = _split_steps(instruction, entry.steps);
 
 			total_optional_steps += optional_steps;
 			total_extra_steps += extra_steps;
@@ -266,9 +727,9 @@ auto Engine::_generate_output_text(const State & state, const Log & log) -> std:
 	output += (boost::format("%-21s%0.3fs\n") % "Other Time:" % Seconds(total_frames - encounter_frames).count()).str();
 	output += (boost::format("%-21s%0.3fs\n\n") % "Total Time:" % Seconds(total_frames).count()).str();
 
-	Engine base_engine{Parameters{_parameters.route, _parameters.encounters, _parameters.maps, 0, _parameters.tas_mode, false, true, -1, CacheType::Dynamic, ""}};
-	auto base_frames{base_engine._optimize(state)};
-	auto base_log{base_engine._finalize(state)};
+	// The base route takes no extra steps and the first option of every
+	// choice, so it is a single replay rather than a second optimization.
+	auto [base_frames, base_encounters] = _evaluate(state, {});
 
 	output += (boost::format("%-21s%0.3fs\n") % "Base Total Time:" % Seconds(base_frames).count()).str();
 	output += (boost::format("%-21s%0.3fs\n\n") % "Time Saved:" % Seconds(base_frames - total_frames).count()).str();
@@ -277,18 +738,6 @@ auto Engine::_generate_output_text(const State & state, const Log & log) -> std:
 	output += (boost::format("%-21s%d\n") % "Extra Steps:" % total_extra_steps).str();
 	output += (boost::format("%-21s%d\n\n") % "Encounters:" % total_encounters).str();
 
-	auto base_encounters{std::accumulate(base_log.begin(), base_log.end(), 0, [](const auto a, const auto & entry) {
-		int encounters{0};
-
-		for (const auto & [step, encounter_index, encounter_id, frames] : entry.encounters) {
-			if (step <= entry.steps) {
-				encounters++;
-			}
-		}
-
-		return a + encounters;
-	})};
-
 	output += (boost::format("%-21s%d\n") % "Base Encounters:" % base_encounters).str();
 	output += (boost::format("%-21s%d\n\n") % "Encounters Saved:" % (base_encounters - total_encounters)).str();
 
@@ -297,142 +746,946 @@ auto Engine::_generate_output_text(const State & state, const Log & log) -> std:
 	return output;
 }
 
-auto Engine::_optimize(const State & state) -> Milliframes {
-	if (state.index == _parameters.route.size()) {
-		return 0_mf;
-	}
+/*
+ * Generates the same information as _generate_output_text() as a single JSON
+ * object, with every frame count in milliframes. In the compact form, used for
+ * NDJSON, the object is written on a single line.
+ */
+auto Engine::_generate_output_json(const State & state, const Log & log, bool compact) -> std::string {
+	std::string newline{compact ? "" : "\n"};
+	std::string indent{compact ? "" : "\t"};
+	std::string space{compact ? "" : " "};
 
-	auto [value, frames] = _cache->get(state);
-	bool update_cache{value < 0};
+	auto field{[&space](const std::string & name, const std::string & value) {
+		return json_string(name) + ":" + space + value;
+	}};
+
+	Milliframes total_frames{0_mf};
+	Milliframes encounter_frames{0_mf};
 
-	auto instruction{_parameters.route[state.index]};
+	int total_optional_steps{0};
+	int total_extra_steps{0};
+	int total_encounters{0};
 
-	int minimum{0};
-	int maximum{0};
+	std::string log_output;
 
-	if (instruction.variable > 0) {
-		minimum = _variables.at(instruction.variable).minimum;
-		maximum = _variables.at(instruction.variable).maximum;
-	}
+	for (const auto & entry : log) {
+		const auto & instruction{_parameters.route[entry.state.index]};
+		auto [optional_steps, extra_steps] = _split_steps(instruction, entry.steps);
 
-	if (instruction.type == InstructionType::Path && state.remaining_segments == 0) {
-		maximum = minimum;
-	}
+		total_optional_steps += optional_steps;
+		total_extra_steps += extra_steps;
 
-	if (value >= 0 && (minimum != maximum || _parameters.always_allow_cache)) {
-		return frames;
-	}
+		std::string encounters_output;
 
-	value = -1;
-	frames = Milliframes::max();
+		for (const auto & [step, encounter_index, encounter_id, frames] : entry.encounters) {
+			auto encounter{_parameters.encounters.get_encounter(static_cast<std::size_t>(encounter_id))};
 
-	for (int i = minimum; i <= maximum || frames == Milliframes::max(); i++) {
-		State work_state{state};
+			// Encounters beyond the steps taken are only those that would have
+			// come next during a search, and take no time.
+			bool fought{step <= entry.steps};
+
+			if (fought) {
+				encounter_frames += frames;
+				total_encounters++;
+			}
 
-		if (instruction.type == InstructionType::Path && i > 0 && _parameters.maximum_step_segments >= 0 && work_state.remaining_segments > 0) {
-			work_state.remaining_segments--;
+			encounters_output += (encounters_output.empty() ? "" : "," + space) + "{";
+			encounters_output += field("step", std::to_string(step)) + "," + space;
+			encounters_output += field("index", std::to_string(encounter_index + 1)) + "," + space;
+			encounters_output += field("id", std::to_string(encounter_id)) + "," + space;
+			encounters_output += field("description", json_string(encounter->get_description())) + "," + space;
+			encounters_output += field("frames", std::to_string(frames.count())) + "," + space;
+			encounters_output += field("fought", fought ? "true" : "false") + "}";
 		}
 
-		auto result{_cycle(&work_state, nullptr, i)};
+		total_frames += entry.frames;
 
-		if (result < Milliframes::max()) {
-			result += _optimize(work_state);
-		}
+		log_output += (log_output.empty() ? "" : "," + newline) + indent + indent + "{";
+		log_output += field("index", std::to_string(entry.state.index)) + "," + space;
+		log_output += field("description", json_string(_get_description(entry))) + "," + space;
+		log_output += field("step_seed", std::to_string(entry.state.step_seed)) + "," + space;
+		log_output += field("step_index", std::to_string(entry.state.step_index)) + "," + space;
+		log_output += field("encounter_seed", std::to_string(entry.state.encounter_seed)) + "," + space;
+		log_output += field("encounter_index", std::to_string(entry.state.encounter_index)) + "," + space;
+		log_output += field("steps", std::to_string(entry.steps)) + "," + space;
+		log_output += field("optional_steps", std::to_string(optional_steps)) + "," + space;
+		log_output += field("extra_steps", std::to_string(extra_steps)) + "," + space;
+		log_output += field("frames", std::to_string(entry.frames.count())) + "," + space;
+		log_output += field("encounters", "[" + encounters_output + "]") + "}";
+	}
 
-		if (result < frames) {
-			value = i;
-			frames = result;
-		}
+	std::set<int> keys;
+
+	for (const auto & [key, value] : _variables) {
+		keys.insert(key);
 	}
 
-	if (update_cache) {
-		_cache->set(state, value, frames);
+	std::string variables_output;
+
+	for (const auto & key : keys) {
+		if (_variables[key].value > 0) {
+			variables_output += (variables_output.empty() ? "" : "," + space) + field((boost::format("%07X") % key).str(), std::to_string(_variables[key].value));
+		}
 	}
 
-	return frames;
+	auto [base_frames, base_encounters] = _evaluate(state, {});
+
+	std::string output{"{" + newline};
+
+	output += indent + field("route", json_string(_route_title)) + "," + newline;
+	output += indent + field("version", std::to_string(_route_version)) + "," + newline;
+	output += indent + field("rosa", json_string(ROSA_VERSION)) + "," + newline;
+	output += indent + field("seed", std::to_string(state.step_seed)) + "," + newline;
+	output += indent + field("maximum_steps", std::to_string(_parameters.maximum_extra_steps)) + "," + newline;
+	output += indent + field("maximum_step_segments", std::to_string(_parameters.maximum_step_segments)) + "," + newline;
+	output += indent + field("tas_mode", _parameters.tas_mode ? "true" : "false") + "," + newline;
+	output += indent + field("minimum", _parameters.maximum_step_segments >= 0 && _parameters.prefer_fewer_locations ? "true" : "false") + "," + newline;
+	output += indent + field("frames", std::to_string(total_frames.count())) + "," + newline;
+	output += indent + field("variables", "{" + variables_output + "}") + "," + newline;
+	output += indent + field("log", "[" + newline + log_output + newline + indent + "]") + "," + newline;
+	output += indent + field("totals", "{" + newline);
+	output += indent + indent + field("encounter_frames", std::to_string(encounter_frames.count())) + "," + newline;
+	output += indent + indent + field("other_frames", std::to_string((total_frames - encounter_frames).count())) + "," + newline;
+	output += indent + indent + field("frames", std::to_string(total_frames.count())) + "," + newline;
+	output += indent + indent + field("base_frames", std::to_string(base_frames.count())) + "," + newline;
+	output += indent + indent + field("optional_steps", std::to_string(total_optional_steps)) + "," + newline;
+	output += indent + indent + field("extra_steps", std::to_string(total_extra_steps)) + "," + newline;
+	output += indent + indent + field("encounters", std::to_string(total_encounters)) + "," + newline;
+	output += indent + indent + field("base_encounters", std::to_string(base_encounters)) + "," + newline;
+	output += indent + indent + field("variables", std::to_string(_variables.size())) + newline;
+	output += indent + "}" + newline + "}\n";
+
+	return output;
 }
 
-auto Engine::_cycle(State * state, LogEntry * log, int value) -> Milliframes {
-	Milliframes frames{0};
-	const auto & instruction{_parameters.route[state->index]};
+/*
+ * Returns the text shown for a log entry in the output: the map for a PATH,
+ * the option taken for a CHOICE, or the text of a SEARCH or NOTE.
+ */
+auto Engine::_get_description(const LogEntry & entry) const -> std::string {
+	const auto & instruction{_parameters.route[entry.state.index]};
 
 	switch (instruction.type) {
+		case InstructionType::Path:
+			return _parameters.maps.get_map(instruction.map).description;
 		case InstructionType::Choice:
-			while (value >= 0) {
-				state->index++;
+			return entry.extra_text;
+		case InstructionType::Note:
+		case InstructionType::Search:
+			return instruction.text;
+		case InstructionType::Data:
+		case InstructionType::Delay:
+		case InstructionType::End:
+		case InstructionType::Option:
+		case InstructionType::Party:
+		case InstructionType::Route:
+		case InstructionType::Save:
+		case InstructionType::Version:
+			break;
+	}
 
-				int level{0};
+	return "";
+}
 
-				while (level > 0 || _parameters.route[state->index].type != InstructionType::Option) {
-					if (_parameters.route[state->index].type == InstructionType::Choice) {
-						level++;
-					} else if (_parameters.route[state->index].type == InstructionType::End) {
-						level--;
-					}
+/*
+ * Splits the steps taken beyond those required into optional and extra steps.
+ * Extra steps are taken in pairs, so an odd number borrows an optional step.
+ */
+auto Engine::_split_steps(const Instruction & instruction, int steps) -> std::pair<int, int> {
+	if (steps <= 0 && instruction.optional_steps <= 0) {
+		return std::make_pair(0, 0);
+	}
 
-					state->index++;
-				}
+	steps -= instruction.required_steps;
 
-				value--;
-			}
+	auto optional_steps{std::min(instruction.optional_steps, steps)};
+	auto extra_steps{steps - optional_steps};
 
-			frames += instruction.transition_count * FRAMES_PER_TRANSITION;
+	if (extra_steps % 2 == 1 && optional_steps > 0) {
+		optional_steps--;
+		extra_steps++;
+	}
 
-			if (log != nullptr) {
-				log->extra_text = _parameters.route[state->index].text;
+	return std::make_pair(optional_steps, extra_steps);
+}
+
+/*
+ * Returns the optimal number of frames from the given state. When pruning, a
+ * candidate is skipped if its lower bound shows that it cannot beat either the
+ * best candidate found so far or the given bound, and each candidate that is
+ * solved is given what remains of that limit as its own bound. A result that
+ * is not less than the bound may then only be a lower bound, in which case the
+ * exact flag is cleared and the result is kept apart as a lower bound for the
+ * state. Exact results do not depend on the bound, so they are cached as usual.
+ */
+auto Engine::_optimize(const State & state, Milliframes bound, bool * exact) -> Milliframes {
+	*exact = true;
+
+	if (state.index == _route.size()) {
+		return 0_mf;
+	}
+
+	bool cache_point{_cache_points[state.index]};
+	auto [value, frames] = cache_point ? _cache->get(state) : std::make_pair(-1, Milliframes::max());
+	bool update_cache{cache_point && value < 0};
+
+	auto [minimum, maximum] = _get_bounds(state);
+
+	if (value >= 0) {
+		return frames;
+	}
+
+	// A state already found to need at least the bound is not searched again.
+	// One that must be searched again is searched without a bound, so that it
+	// is never searched more than twice.
+	if (update_cache && _bound_cache && bound < Milliframes::max()) {
+		auto lower_bound{_bound_cache->get(state).second};
+
+		if (lower_bound != Milliframes::max()) {
+			if (lower_bound >= bound) {
+				*exact = false;
+				return lower_bound;
 			}
 
-			break;
-		case InstructionType::Delay:
-			frames += Frames{instruction.number};
-			break;
-		case InstructionType::End:
-		case InstructionType::Note:
-			break;
-		case InstructionType::Option: {
-			int level{0};
-
-			while (level > 0 || _parameters.route[state->index + 1].type != InstructionType::End) {
-				if (_parameters.route[state->index + 1].type == InstructionType::Choice) {
-					level++;
-				} else if (_parameters.route[state->index + 1].type == InstructionType::End) {
-					level--;
+			bound = Milliframes::max();
+		}
+	}
+
+	_solved_states++;
+
+	value = -1;
+	frames = Milliframes::max();
+
+	int i{minimum};
+
+	PathCursor cursor;
+
+	// Candidates that were skipped, and whose results are only lower bounds.
+	std::vector<std::pair<int, Milliframes>> skipped_results;
+
+	if (_pool && maximum > minimum && !_pool->is_saturated()) {
+		std::vector<State> work_states(static_cast<std::size_t>(maximum - minimum + 1), state);
+		std::vector<Milliframes> results(work_states.size());
+		std::vector<uint8_t> exact_results(work_states.size(), 1);
+		TaskGroup group{*_pool};
+
+		for (std::size_t j = 0; j < work_states.size(); j++) {
+			results[j] = _advance(state, &work_states[j], minimum + static_cast<int>(j), &cursor);
+
+			if (results[j] < Milliframes::max()) {
+				if (_prune(work_states[j], bound, &results[j])) {
+					skipped_results.emplace_back(i + static_cast<int>(j), results[j]);
+				} else {
+					group.run([this, &work_states, &results, &exact_results, bound, j]() {
+						bool child_exact{true};
+						results[j] += _optimize(work_states[j], _get_child_bound(bound, results[j]), &child_exact);
+						exact_results[j] = child_exact;
+					});
 				}
+			}
+		}
+
+		group.wait();
 
-				state->index++;
+		for (std::size_t j = 0; j < results.size(); j++) {
+			if (!exact_results[j]) {
+				skipped_results.emplace_back(i, results[j]);
 			}
 
-			break;
+			if (results[j] < frames) {
+				value = i;
+				frames = results[j];
+			}
+
+			i++;
 		}
-		case InstructionType::Party:
-			state->party = Party{instruction.text};
-			break;
-		case InstructionType::Path: {
-			state->segment_encounters = 0;
+	}
 
-			frames += instruction.transition_count * FRAMES_PER_TRANSITION;
-			frames += _step(state, log, instruction.tiles, instruction.required_steps);
+	for (; i <= maximum || frames == Milliframes::max(); i++) {
+		State work_state{state};
+		auto result{_advance(state, &work_state, i, &cursor)};
 
-			if (value > 0) {
-				int optional_steps{std::min(instruction.optional_steps, value)};
-				int extra_steps{value - optional_steps};
+		if (result < Milliframes::max()) {
+			if (_prune(work_state, std::min(bound, frames), &result)) {
+				skipped_results.emplace_back(i, result);
+			} else {
+				bool child_exact{true};
+				result += _optimize(work_state, _get_child_bound(std::min(bound, frames), result), &child_exact);
 
-				if (extra_steps % 2 == 1 && optional_steps > 0) {
-					extra_steps++;
-					optional_steps--;
+				if (!child_exact) {
+					skipped_results.emplace_back(i, result);
 				}
+			}
+		}
 
-				if (extra_steps % 2 == 1 && !instruction.can_single_step) {
-					extra_steps--;
+		if (result < frames) {
+			value = i;
+			frames = result;
+		}
+	}
+
+	// Candidates skipped because of the best candidate can never be chosen over
+	// it, even on the tie-break, but those skipped because of the bound can.
+	for (const auto & [candidate, result] : skipped_results) {
+		if (result < frames || (result == frames && candidate <= value)) {
+			*exact = false;
+		}
+	}
+
+	if (*exact && update_cache) {
+		_cache->set(state, value, frames);
+		_poll();
+	} else if (update_cache && _bound_cache) {
+		_bound_cache->set(state, 0, frames);
+	}
+
+	return frames;
+}
+
+/*
+ * Returns the bound for a candidate that reaches its state after the given
+ * frames, which is whatever is left of the limit on the whole candidate.
+ */
+auto Engine::_get_child_bound(Milliframes limit, Milliframes frames) -> Milliframes {
+	return limit == Milliframes::max() ? limit : limit - frames;
+}
+
+/*
+ * Checks whether the candidate that reaches the given state, after the given
+ * frames, can be skipped because it cannot finish in less than the bound. If
+ * so, the frames are updated to include the lower bound for the state.
+ */
+auto Engine::_prune(const State & state, Milliframes bound, Milliframes * frames) -> bool {
+	if (!_parameters.prune || bound == Milliframes::max() || state.index == _route.size()) {
+		return false;
+	}
+
+	auto lower_bound{*frames + _get_lower_bound(state)};
+
+	if (lower_bound < bound) {
+		return false;
+	}
+
+	_pruned_candidates++;
+	*frames = lower_bound;
+
+	return true;
+}
+
+/*
+ * Computes, for each route index, a lower bound on the frames needed to reach
+ * the end of the route from any state at that index. Each PATH contributes its
+ * tile and transition time, plus the fewest encounters any starting position
+ * can produce in its required steps, at the shortest duration in its group.
+ */
+void Engine::_compute_lower_bounds() {
+	const auto & route{_route};
+
+	_lower_bounds.assign(route.size() + 1, 0_mf);
+
+	for (auto index{route.size()}; index-- > 0;) {
+		const auto & instruction{route[index]};
+		auto lower_bound{Milliframes::max()};
+
+		if (instruction.type == InstructionType::Path) {
+			lower_bound = instruction.frames + instruction.tiles * FRAMES_PER_TILE;
+			const auto & step_table{_step_tables.get(instruction.encounter_rate)};
+			auto encounters{std::numeric_limits<int>::max()};
+
+			for (int position = 0; position < STEP_CYCLE_LENGTH && encounters > 0; position++) {
+				encounters = std::min(encounters, step_table.count_encounters(position, instruction.required_steps));
+			}
+
+			lower_bound += _get_encounter_lower_bound(instruction, encounters) + _lower_bounds[index + 1];
+		} else {
+			auto options{instruction.type == InstructionType::Choice ? instruction.number : 1};
+
+			for (int i = 0; i < options; i++) {
+				State state{};
+				state.index = index;
+
+				auto frames{_cycle(&state, nullptr, i)};
+				lower_bound = std::min(lower_bound, frames + _lower_bounds[state.index]);
+			}
+		}
+
+		_lower_bounds[index] = lower_bound;
+	}
+}
+
+/*
+ * Computes the scope of each index from the constraints on the variables of
+ * the instructions from that index onward. Only variables given explicitly are
+ * included, so the suffix after the last of them has a scope of zero and
+ * shares its states with unconstrained runs.
+ */
+void Engine::_compute_scopes() {
+	_scopes.assign(_route.size() + 1, 0);
+
+	std::set<int> seen;
+	uint64_t hash{0};
+
+	for (auto index{_route.size()}; index-- > 0;) {
+		auto variable{_route[index].variable};
+
+		if (variable > 0 && _constrained_variables.count(variable) > 0 && seen.insert(variable).second) {
+			const auto & bounds{_variables.at(variable)};
+			hash = CacheTable::get_hash(std::make_pair(hash ^ static_cast<uint64_t>(variable), (static_cast<uint64_t>(static_cast<uint32_t>(bounds.minimum)) << 32U) | static_cast<uint32_t>(bounds.maximum))); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+		}
+
+		if (!seen.empty()) {
+			_scopes[index] = std::max(static_cast<uint32_t>(hash), static_cast<uint32_t>(1));
+		}
+	}
+}
+
+/*
+ * Computes the hashes used for suffix keys. Each index is identified by the
+ * instructions from it to the end of the route. A search in progress is also
+ * identified by its SEARCH instruction, as that determines the meaning of its
+ * state, and a party by its definition rather than its ID, which depends on
+ * the order of the route.
+ */
+void Engine::_compute_suffix_hashes() {
+	std::vector<uint64_t> instruction_hashes(_route.size(), 0);
+
+	for (std::size_t index = 0; index < _route.size(); index++) {
+		const auto & instruction{_parameters.route[index]};
+		bool descriptive{false};
+
+		switch (instruction.type) {
+			case InstructionType::Data:
+			case InstructionType::Note:
+			case InstructionType::Option:
+			case InstructionType::Route:
+			case InstructionType::Version:
+				descriptive = true;
+				break;
+			case InstructionType::Choice:
+			case InstructionType::Delay:
+			case InstructionType::End:
+			case InstructionType::Party:
+			case InstructionType::Path:
+			case InstructionType::Save:
+			case InstructionType::Search:
+				break;
+		}
+
+		// Some instructions only have text that describes them, but the text of
+		// a PARTY defines the party.
+		auto text{(boost::format("%d|%s|%s|%s|%d|%d|%d|%d|%d|%d|%d|%d|%d|%d|%d|%d|%d") % static_cast<int>(instruction.type) % (descriptive ? "" : instruction.text) % instruction.party % (instruction.expression_string ? *instruction.expression_string : "") % instruction.variable % instruction.number % instruction.tiles % instruction.required_steps % instruction.optional_steps % instruction.map % instruction.transition_count % instruction.can_single_step % instruction.can_double_step % instruction.can_step_during_save % instruction.first_battle_penalty.count() % instruction.end_search % instruction.numbers.size()).str()};
+
+		for (const auto & number : instruction.numbers) {
+			text += (boost::format("|%d") % number).str();
+		}
+
+		instruction_hashes[index] = CacheMetadata::hash(text);
+	}
+
+	_suffix_hashes.assign(_route.size() + 1, 0);
+	_search_hashes.assign(_route.size(), 0);
+
+	for (auto index{_route.size()}; index-- > 0;) {
+		_suffix_hashes[index] = CacheTable::get_hash(std::make_pair(_suffix_hashes[index + 1], instruction_hashes[index]));
+
+		if (_route[index].type == InstructionType::Search) {
+			_search_hashes[index] = instruction_hashes[index];
+		}
+	}
+
+	for (std::size_t id = 0; id < _parties.get_size(); id++) {
+		const auto & keys{_parties.get_party(static_cast<uint16_t>(id)).get_keys()};
+		_party_hashes.push_back(CacheTable::get_hash(std::make_pair(static_cast<uint64_t>(keys.first), keys.second)));
+	}
+}
+
+/*
+ * Returns the location of the given state, which must be updated whenever its
+ * index, party or search changes.
+ */
+auto Engine::_get_location(const State & state) const -> uint64_t {
+	if (_suffix_hashes.empty()) {
+		return (static_cast<uint64_t>(state.party) << 48U) + (static_cast<uint64_t>(state.index) << 32U) + _scopes[state.index]; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+	}
+
+	return CacheTable::get_hash(std::make_pair(_suffix_hashes[state.index] ^ _scopes[state.index], _party_hashes[state.party] ^ _search_hashes[state.search_index]));
+}
+
+auto Engine::_get_encounter_lower_bound(const CompiledInstruction & instruction, int encounters) const -> Milliframes {
+	if (encounters == 0) {
+		return std::min(0_mf, instruction.first_battle_penalty);
+	}
+
+	auto duration{Milliframes::max()};
+
+	for (std::size_t i = 0; i < 8; i++) { // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+		auto encounter{_parameters.encounters.get_encounter_from_group(static_cast<std::size_t>(instruction.encounter_group), i)};
+
+		if (encounter) {
+			duration = std::min(duration, encounter->get_shortest_duration(_parameters.tas_mode));
+		}
+	}
+
+	return encounters * duration + instruction.first_battle_penalty;
+}
+
+/*
+ * Returns a lower bound on the frames needed to reach the end of the route from
+ * the given state. At a PATH, the encounters in its required steps are known
+ * exactly from the current position, so they replace the precomputed minimum.
+ */
+auto Engine::_get_lower_bound(const State & state) const -> Milliframes {
+	const auto & instruction{_route[state.index]};
+
+	if (instruction.type != InstructionType::Path) {
+		return _lower_bounds[state.index];
+	}
+
+	const auto & step_table{_step_tables.get(instruction.encounter_rate)};
+	auto encounters{step_table.count_encounters(StepTable::get_position(state.step_seed, state.step_index), instruction.required_steps)};
+
+	auto lower_bound{instruction.frames + instruction.tiles * FRAMES_PER_TILE};
+
+	return lower_bound + _get_encounter_lower_bound(instruction, encounters) + _lower_bounds[state.index + 1];
+}
+
+/*
+ * Returns the cost of a complete route from the given state, to be used as the
+ * upper bound for pruning. A greedy route is always available, and a route
+ * replayed from the variables of a previous output is used if it is better.
+ */
+auto Engine::_get_incumbent(const State & state) -> Milliframes {
+	auto greedy_frames{_simulate(state, [this](const State & current_state) {
+		auto [minimum, maximum] = _get_bounds(current_state);
+		auto best_value{minimum};
+		auto best_frames{Milliframes::max()};
+
+		PathCursor cursor;
+
+		for (auto i{minimum}; i <= maximum; i++) {
+			State work_state{current_state};
+			auto frames{_advance(current_state, &work_state, i, &cursor)};
+
+			if (frames < Milliframes::max() && frames + _lower_bounds[work_state.index] < best_frames) {
+				best_value = i;
+				best_frames = frames + _lower_bounds[work_state.index];
+			}
+		}
+
+		return best_value;
+	})};
+
+	auto frames{greedy_frames};
+
+	std::cerr << boost::format("Incumbent: greedy route takes %0.3fs\n") % Seconds(greedy_frames).count();
+
+	if (_incumbent) {
+		auto previous_frames{_simulate(state, [this](const State & current_state) {
+			const auto & instruction{_route[current_state.index]};
+			auto [minimum, maximum] = _get_bounds(current_state);
+			auto value{0};
+
+			if (instruction.variable > 0 && _incumbent->first.count(instruction.variable) > 0) {
+				value = _incumbent->first.at(instruction.variable);
+			}
+
+			return std::clamp(value, minimum, maximum);
+		})};
+
+		std::cerr << boost::format("Incumbent: previous route takes %0.3fs (%0.3fs when generated)\n") % Seconds(previous_frames).count() % Seconds(_incumbent->second).count();
+
+		frames = std::min(frames, previous_frames);
+	}
+
+	return frames;
+}
+
+/*
+ * Follows a single route from the given state, using the given function to
+ * choose the value at each instruction. As in _optimize(), the value is
+ * increased if necessary until the route is able to continue.
+ */
+auto Engine::_simulate(State state, const std::function<int(const State &)> & choose) -> Milliframes {
+	Milliframes total_frames{0};
+
+	while (state.index < _route.size()) {
+		auto value{choose(state)};
+
+		PathCursor cursor;
+		State work_state{state};
+		auto frames{_advance(state, &work_state, value, &cursor)};
+
+		while (frames == Milliframes::max()) {
+			value++;
+			work_state = state;
+			frames = _advance(state, &work_state, value, &cursor);
+		}
+
+		total_frames += frames;
+		state = work_state;
+	}
+
+	return total_frames;
+}
+
+/*
+ * Follows the route from the given state with every variable set to the given
+ * value, or to zero if it has none, and returns its frames and the number of
+ * encounters counted as in the output. As in _simulate(), a value is increased
+ * if necessary until the route is able to continue. The engine's variable
+ * constraints are ignored.
+ */
+auto Engine::_evaluate(State state, const std::unordered_map<int, int> & variables) -> std::pair<Milliframes, int> {
+	Milliframes total_frames{0};
+	int total_encounters{0};
+
+	while (state.index < _route.size()) {
+		const auto & instruction{_route[state.index]};
+		auto value{0};
+
+		if (instruction.variable > 0 && variables.count(instruction.variable) > 0) {
+			value = variables.at(instruction.variable);
+		}
+
+		while (true) {
+			LogEntry entry{state};
+			State work_state{state};
+
+			if (instruction.type == InstructionType::Path && value > 0 && _parameters.maximum_step_segments >= 0 && work_state.remaining_segments > 0) {
+				work_state.remaining_segments--;
+			}
+
+			auto frames{_cycle(&work_state, &entry, value)};
+
+			if (frames < Milliframes::max()) {
+				for (const auto & [step, encounter_index, encounter_id, encounter_frames] : entry.encounters) {
+					if (step <= entry.steps) {
+						total_encounters++;
+					}
 				}
 
-				int tiles{instruction.can_double_step ? extra_steps : extra_steps * 2};
+				total_frames += frames;
+				state = work_state;
 
-				if (tiles % 2 == 1) {
-					tiles++;
+				break;
+			}
+
+			value++;
+		}
+	}
+
+	return std::make_pair(total_frames, total_encounters);
+}
+
+/*
+ * The frontier engine solves the same recurrence as _optimize() without
+ * recursion. A forward pass enumerates every distinct reachable state at each
+ * route index, and a backward pass then resolves each frontier from the last
+ * index to the first, looking up successor costs in the cache. A frontier is
+ * released as soon as its decisions have been recorded.
+ */
+auto Engine::_optimize_frontier(const State & state) -> Milliframes {
+	if (state.index == _route.size()) {
+		return 0_mf;
+	}
+
+	auto frontiers{_expand_frontiers(state)};
+
+	for (auto index{_route.size()}; index-- > state.index;) {
+		auto & frontier{frontiers[index]};
+
+		parallel_for(_pool.get(), frontier.size(), FRONTIER_BATCH_SIZE, [this, &frontier](std::size_t begin, std::size_t end) {
+			for (auto i{begin}; i < end; i++) {
+				if (i + PREFETCH_DISTANCE < end) {
+					_cache->prefetch(frontier[i + PREFETCH_DISTANCE]);
+				}
+
+				_resolve(frontier[i]);
+			}
+		});
+
+		frontier.clear();
+		frontier.shrink_to_fit();
+	}
+
+	return _cache->get(state).second;
+}
+
+auto Engine::_expand_frontiers(const State & state) -> std::vector<std::vector<State>> {
+	std::vector<std::vector<State>> frontiers(_route.size());
+	std::vector<tsl::sparse_set<std::pair<uint64_t, uint64_t>, boost::hash<std::pair<uint64_t, uint64_t>>>> seen(_route.size());
+
+	if (state.index >= _route.size()) {
+		return frontiers;
+	}
+
+	frontiers[state.index].push_back(state);
+
+	std::size_t total_states{0};
+	std::size_t largest_frontier{0};
+	std::size_t largest_index{0};
+
+	for (auto index{state.index}; index < _route.size(); index++) {
+		const auto & frontier{frontiers[index]};
+		std::vector<std::vector<State>> successors((frontier.size() + FRONTIER_BATCH_SIZE - 1) / FRONTIER_BATCH_SIZE);
+
+		parallel_for(_pool.get(), frontier.size(), FRONTIER_BATCH_SIZE, [this, &frontier, &successors](std::size_t begin, std::size_t end) {
+			auto & batch{successors[begin / FRONTIER_BATCH_SIZE]};
+
+			for (auto i{begin}; i < end; i++) {
+				if (i + PREFETCH_DISTANCE < end) {
+					_cache->prefetch(frontier[i + PREFETCH_DISTANCE]);
+				}
+
+				_expand(frontier[i], &batch);
+			}
+		});
+
+		for (auto & batch : successors) {
+			for (auto & successor : batch) {
+				if (successor.index < _route.size() && seen[successor.index].insert(successor.get_keys()).second) {
+					frontiers[successor.index].push_back(std::move(successor));
+				}
+			}
+		}
+
+		seen[index] = {};
+
+		total_states += frontier.size();
+
+		if (frontier.size() > largest_frontier) {
+			largest_frontier = frontier.size();
+			largest_index = index;
+		}
+	}
+
+	std::cerr << boost::format("Frontier: %d states, largest frontier %d at index %d\n") % total_states % largest_frontier % largest_index;
+
+	return frontiers;
+}
+
+/*
+ * Queues the successors of a state for every candidate value. As in
+ * _get_forced_value(), values beyond the maximum are only tried until one
+ * allows the route to continue, and _resolve() follows the same rule, so that
+ * it only looks up successors queued here.
+ */
+void Engine::_expand(const State & state, std::vector<State> * successors) {
+	auto [value, frames] = _cache->get(state);
+	auto [minimum, maximum] = _get_bounds(state);
+
+	if (value >= 0) {
+		return;
+	}
+
+	bool found{false};
+	PathCursor cursor;
+
+	for (int i = minimum; i <= maximum || !found; i++) {
+		State work_state{state};
+
+		if (_advance(state, &work_state, i, &cursor) < Milliframes::max()) {
+			successors->push_back(work_state);
+			found = true;
+		}
+	}
+}
+
+void Engine::_resolve(const State & state) {
+	auto [value, frames] = _cache->get(state);
+	auto [minimum, maximum] = _get_bounds(state);
+
+	if (value >= 0) {
+		return;
+	}
+
+	value = -1;
+	frames = Milliframes::max();
+
+	bool found{false};
+	PathCursor cursor;
+
+	for (int i = minimum; i <= maximum || !found; i++) {
+		State work_state{state};
+		auto result{_advance(state, &work_state, i, &cursor)};
+
+		if (result < Milliframes::max()) {
+			found = true;
+
+			if (work_state.index < _route.size()) {
+				auto [successor_value, successor_frames] = _cache->get(work_state);
+
+				if (successor_value < 0) {
+					std::cerr << "BUG: _resolve() found a successor that was never expanded. Please report this.\n";
 				}
 
-				frames += _step(state, log, tiles, optional_steps + extra_steps);
+				result = successor_frames == Milliframes::max() ? successor_frames : result + successor_frames;
+			}
+		}
+
+		// A successor that cannot reach the end of the route still provides
+		// the value, so that the state is recorded as a dead end.
+		if (result < frames || (found && value < 0)) {
+			value = i;
+			frames = result;
+		}
+	}
+
+	_cache->set(state, value, frames);
+	_poll();
+}
+
+/*
+ * Gives the checkpoint a chance to run after a state is added to the cache.
+ *
+ * Under a memory limit, the evictions are also checked once every few thousand
+ * states. Once the cache has turned over several times for the same seed and
+ * nearly every state solved has been evicted again, the limit is far below
+ * what the route needs, and the run can take hours instead of seconds, so a
+ * warning is given. A full cache left by earlier seeds turns over only once.
+ */
+void Engine::_poll() {
+	thread_local uint32_t calls{0};
+
+	if (_checkpoint) {
+		_checkpoint->poll(*_cache);
+	}
+
+	if (_memory_limit > 0 && ++calls >= EVICTION_POLL_INTERVAL) {
+		calls = 0;
+
+		auto statistics{_cache->get_statistics()};
+		auto evictions{statistics.evictions - _initial_evictions};
+
+		if (evictions >= statistics.capacity * EVICTION_WARNING_TURNOVER && static_cast<double>(evictions) > static_cast<double>(_solved_states) * EVICTION_WARNING_RATIO && !_eviction_warning.exchange(true)) {
+			std::cerr << boost::format("WARNING: %d of the %d states solved so far were evicted... the memory limit is far below what this route needs, and the run may take much longer than without it\n") % evictions % _solved_states;
+		}
+	}
+}
+
+auto Engine::_get_bounds(const State & state) const -> std::pair<int, int> {
+	const auto & instruction{_route[state.index]};
+	const auto * variable{_instruction_variables[state.index]};
+
+	int minimum{0};
+	int maximum{0};
+
+	if (variable != nullptr) {
+		minimum = variable->minimum;
+		maximum = variable->maximum;
+	}
+
+	if (instruction.type == InstructionType::Path && state.remaining_segments == 0) {
+		maximum = minimum;
+	}
+
+	return std::make_pair(minimum, maximum);
+}
+
+/*
+ * Returns the value _optimize() chooses at an instruction without a variable:
+ * the smallest one that allows the route to continue.
+ */
+auto Engine::_get_forced_value(const State & state) -> int {
+	auto value{_get_bounds(state).first};
+	State work_state{state};
+
+	while (_advance(state, &work_state, value, nullptr) == Milliframes::max()) {
+		value++;
+		work_state = state;
+	}
+
+	return value;
+}
+
+auto Engine::_advance(const State & state, State * work_state, int value, PathCursor * cursor) -> Milliframes {
+	if (_route[state.index].type != InstructionType::Path) {
+		return _cycle(work_state, nullptr, value);
+	}
+
+	if (value > 0 && _parameters.maximum_step_segments >= 0 && work_state->remaining_segments > 0) {
+		work_state->remaining_segments--;
+	}
+
+	if (cursor == nullptr) {
+		return _cycle(work_state, nullptr, value);
+	}
+
+	return _sweep(work_state, value, cursor);
+}
+
+/*
+ * Equivalent to _cycle() for a PATH instruction, but reuses the steps already
+ * simulated by the cursor. Candidates must be visited in increasing order of
+ * value, as the number of steps taken never decreases as the value increases.
+ */
+auto Engine::_sweep(State * state, int value, PathCursor * cursor) -> Milliframes {
+	const auto & instruction{_route[state->index]};
+	auto [tiles, steps] = _get_extra_steps(instruction, value);
+
+	if (cursor->steps < 0 || steps < cursor->steps) {
+		cursor->state = *state;
+		cursor->state.segment_encounters = 0;
+		cursor->frames = instruction.frames;
+		cursor->frames += _step(&cursor->state, nullptr, instruction.tiles, instruction.required_steps);
+		cursor->steps = 0;
+	}
+
+	cursor->frames += _step(&cursor->state, nullptr, 0, steps - cursor->steps);
+	cursor->steps = steps;
+
+	auto remaining_segments{state->remaining_segments};
+
+	*state = cursor->state;
+	state->remaining_segments = remaining_segments;
+
+	if (!_end_path(state, instruction)) {
+		return Milliframes::max();
+	}
+
+	state->index++;
+	state->location = _get_location(*state);
+
+	return cursor->frames + tiles * FRAMES_PER_TILE;
+}
+
+auto Engine::_cycle(State * state, LogEntry * log, int value) -> Milliframes {
+	Milliframes frames{0};
+	const auto & instruction{_route[state->index]};
+
+	switch (instruction.type) {
+		case InstructionType::Choice:
+			state->index = _route.get_option(instruction, value);
+			frames += instruction.frames;
+
+			if (log != nullptr) {
+				log->extra_text = _parameters.route[state->index].text;
+			}
+
+			break;
+		case InstructionType::Delay:
+			frames += instruction.frames;
+			break;
+		case InstructionType::End:
+		case InstructionType::Note:
+			break;
+		case InstructionType::Option:
+			// Skip to just before the END, which is reached by the increment below.
+			state->index = instruction.target - 1;
+			break;
+		case InstructionType::Party:
+			state->party = instruction.party;
+			break;
+		case InstructionType::Path: {
+			state->segment_encounters = 0;
+
+			frames += instruction.frames;
+			frames += _step(state, log, instruction.tiles, instruction.required_steps);
+
+			if (value > 0) {
+				auto [tiles, steps] = _get_extra_steps(instruction, value);
+				frames += _step(state, log, tiles, steps);
 			}
 
 			if ((log != nullptr) && state->search_active) {
@@ -445,19 +1698,13 @@ auto Engine::_cycle(State * state, LogEntry * log, int value) -> Milliframes {
 				}
 			}
 
-			if (instruction.end_search) {
-				if (state->search_active && !state->search_complete) {
-					return Milliframes::max();
-				}
-
-				state->search_party = Party{""};
-				state->search_active = false;
+			if (!_end_path(state, instruction)) {
+				return Milliframes::max();
 			}
 
 			break;
 		}
 		case InstructionType::Route:
-			_route_title = instruction.text;
 			break;
 		case InstructionType::Save:
 			// TODO(jason@calindora.com): This needs to be implemented, but it
@@ -465,27 +1712,19 @@ auto Engine::_cycle(State * state, LogEntry * log, int value) -> Milliframes {
 			// number in the instruction.
 			break;
 		case InstructionType::Search:
-			state->search_targets.clear();
-
-			for (const auto & encounter_id : instruction.numbers) {
-				state->search_targets.push_back(static_cast<std::size_t>(encounter_id));
-			}
-
-			state->search_expression = instruction.expression;
-			state->search_values.fill(false);
-			state->search_party = Party{instruction.party};
+			state->search_index = static_cast<uint16_t>(state->index);
+			state->search_state = 0;
 			state->search_active = true;
 			state->search_complete = false;
 
-			break;
-		case InstructionType::Version:
-			_route_version = instruction.number;
 			break;
 		case InstructionType::Data:
+		case InstructionType::Version:
 			break;
 	}
 
 	state->index++;
+	state->location = _get_location(*state);
 
 	if (log != nullptr) {
 		log->frames = frames;
@@ -495,80 +1734,95 @@ auto Engine::_cycle(State * state, LogEntry * log, int value) -> Milliframes {
 }
 
 auto Engine::_step(State * state, LogEntry * log, int tiles, int steps) -> Milliframes {
-	const auto & instruction{_parameters.route[state->index]};
-	const auto & map{_parameters.maps.get_map(instruction.map)};
+	const auto & instruction{_route[state->index]};
+	const auto & step_table{_step_tables.get(instruction.encounter_rate)};
 
 	Milliframes frames{tiles * FRAMES_PER_TILE};
 
-	for (auto i{0}; i < steps; i++) {
-		state->step_index = (state->step_index + 1) % (UINT8_MAX + 1);
-
-		if (state->step_index == 0) {
-			state->step_seed = (state->step_seed + SEED_UPDATE_DELTA) % (UINT8_MAX + 1);
-		}
-
-		if ((_rng_data[static_cast<std::size_t>(state->step_index)] + state->step_seed) % (UINT8_MAX + 1) < map.encounter_rate) {
-			auto encounter_rng{(_rng_data[static_cast<std::size_t>(state->encounter_index)] + state->encounter_seed) % (UINT8_MAX + 1)};
-			std::size_t encounter_group_index{7}; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
-
-			if (encounter_rng < 43) { // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
-				encounter_group_index = 0;
-			} else if (encounter_rng < 86) { // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
-				encounter_group_index = 1;
-			} else if (encounter_rng < 129) { // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
-				encounter_group_index = 2;
-			} else if (encounter_rng < 172) { // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
-				encounter_group_index = 3;
-			} else if (encounter_rng < 204) { // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
-				encounter_group_index = 4;
-			} else if (encounter_rng < 236) { // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
-				encounter_group_index = 5; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
-			} else if (encounter_rng < 252) { // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
-				encounter_group_index = 6; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
-			}
+	// Rather than checking every step, jump directly from one encounter to the
+	// next using the precomputed positions for this encounter rate.
+	auto position{StepTable::get_position(state->step_seed, state->step_index)};
+	auto remaining_steps{steps};
 
-			auto encounter{_parameters.encounters.get_encounter_from_group(static_cast<std::size_t>(map.encounter_group), encounter_group_index)};
-			auto encounter_id{encounter->get_id()};
-			auto encounter_frames{encounter->get_duration(state->party, _parameters.tas_mode)};
+	while (remaining_steps > 0) {
+		auto distance{step_table.get_distance(position)};
 
-			if (state->segment_encounters == 0) {
-				encounter_frames += instruction.first_battle_penalty;
-			}
+		if (distance > remaining_steps) {
+			position = (position + remaining_steps) % STEP_CYCLE_LENGTH;
+			break;
+		}
 
-			state->segment_encounters++;
+		position = (position + distance) % STEP_CYCLE_LENGTH;
+		remaining_steps -= distance;
+
+		state->step_seed = StepTable::get_step_seed(position);
+		state->step_index = StepTable::get_step_index(position);
+
+		auto encounter_rng{(RNG_DATA[static_cast<std::size_t>(state->encounter_index)] + state->encounter_seed) % (UINT8_MAX + 1)};
+		std::size_t encounter_group_index{7}; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+
+		if (encounter_rng < 43) { // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+			encounter_group_index = 0;
+		} else if (encounter_rng < 86) { // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+			encounter_group_index = 1;
+		} else if (encounter_rng < 129) { // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+			encounter_group_index = 2;
+		} else if (encounter_rng < 172) { // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+			encounter_group_index = 3;
+		} else if (encounter_rng < 204) { // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+			encounter_group_index = 4;
+		} else if (encounter_rng < 236) { // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+			encounter_group_index = 5; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+		} else if (encounter_rng < 252) { // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+			encounter_group_index = 6; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+		}
 
-			frames += encounter_frames;
+		const auto & encounter{_encounter_table.get_slot(state->party, instruction.group_index, encounter_group_index)};
+		auto encounter_id{encounter.id};
+		auto encounter_frames{_parameters.tas_mode ? encounter.minimum : encounter.average};
 
-			if (log != nullptr) {
-				auto encounter_step{state->step_index - log->state.step_index};
-				auto step_seed_delta{state->step_seed - log->state.step_seed};
+		if (state->segment_encounters == 0) {
+			encounter_frames += instruction.first_battle_penalty;
+		}
 
-				if (step_seed_delta > 0) {
-					encounter_step += (step_seed_delta / SEED_UPDATE_DELTA) * (UINT8_MAX + 1);
-				} else if (step_seed_delta < 0) {
-					encounter_step += ((step_seed_delta + (UINT8_MAX + 1)) / SEED_UPDATE_DELTA) * (UINT8_MAX + 1);
-				}
+		state->segment_encounters++;
 
-				log->encounters.emplace_back(std::make_tuple(encounter_step, state->encounter_index, encounter_id, encounter_frames));
-			}
+		frames += encounter_frames;
 
-			if (state->search_active && !state->search_complete) {
-				_assign_search_encounter(state, encounter_id, *state->search_expression);
+		if (log != nullptr) {
+			auto encounter_step{state->step_index - log->state.step_index};
+			auto step_seed_delta{state->step_seed - log->state.step_seed};
 
-				if (_check_search_complete(state, *state->search_expression)) {
-					state->party = state->search_party;
-					state->search_complete = true;
-				}
+			if (step_seed_delta > 0) {
+				encounter_step += (step_seed_delta / SEED_UPDATE_DELTA) * (UINT8_MAX + 1);
+			} else if (step_seed_delta < 0) {
+				encounter_step += ((step_seed_delta + (UINT8_MAX + 1)) / SEED_UPDATE_DELTA) * (UINT8_MAX + 1);
 			}
 
-			state->encounter_index = (state->encounter_index + 1) % (UINT8_MAX + 1);
+			log->encounters.emplace_back(std::make_tuple(encounter_step, state->encounter_index, encounter_id, encounter_frames));
+		}
+
+		if (state->search_active && !state->search_complete) {
+			const auto & search{_route.get_search(_route[state->search_index])};
+
+			state->search_state = search.get_next_state(state->search_state, encounter_id);
 
-			if (state->encounter_index == 0) {
-				state->encounter_seed = (state->encounter_seed + SEED_UPDATE_DELTA) % (UINT8_MAX + 1);
+			if (search.is_complete(state->search_state)) {
+				state->party = _route[state->search_index].party;
+				state->search_complete = true;
 			}
 		}
+
+		state->encounter_index = (state->encounter_index + 1) % (UINT8_MAX + 1);
+
+		if (state->encounter_index == 0) {
+			state->encounter_seed = (state->encounter_seed + SEED_UPDATE_DELTA) % (UINT8_MAX + 1);
+		}
 	}
 
+	state->step_seed = StepTable::get_step_seed(position);
+	state->step_index = StepTable::get_step_index(position);
+
 	if (log != nullptr) {
 		log->steps += steps;
 	}
@@ -576,67 +1830,40 @@ auto Engine::_step(State * state, LogEntry * log, int tiles, int steps) -> Milli
 	return frames;
 }
 
-auto Engine::_check_search_complete(State * state, const peg::Ast & expression) -> bool {
-	using peg::udl::operator""_;
+auto Engine::_end_path(State * state, const CompiledInstruction & instruction) -> bool {
+	if (instruction.end_search) {
+		if (state->search_active && !state->search_complete) {
+			return false;
+		}
 
-	switch (expression.tag) {
-		case "disjunction"_:
-			return std::any_of(expression.nodes.begin(), expression.nodes.end(), [state](const auto & node){ return _check_search_complete(state, *node); });
-		case "conjunction"_:
-		case "sequence"_:
-			return std::all_of(expression.nodes.begin(), expression.nodes.end(), [state](const auto & node){ return _check_search_complete(state, *node); });
-		case "number"_:
-			return state->search_values.at(expression.token_to_number<std::size_t>());
-		default:
-			std::cerr << "BUG: Unimplemented tag in _check_search_complete. Please report this." << std::endl;
-			break;
+		state->search_active = false;
 	}
 
-	return false;
+	return true;
 }
 
-auto Engine::_assign_search_encounter(State * state, std::size_t encounter_id, const peg::Ast & expression) -> bool {
-	using peg::udl::operator""_;
+auto Engine::_get_extra_steps(const CompiledInstruction & instruction, int value) -> std::pair<int, int> {
+	if (value <= 0) {
+		return std::make_pair(0, 0);
+	}
 
-	switch (expression.tag) {
-		case "conjunction"_:
-			for (const auto & node : expression.nodes) {
-				if (!_check_search_complete(state, *node)) {
-					if (_assign_search_encounter(state, encounter_id, *node)) {
-						return true;
-					}
-				}
-			}
+	int optional_steps{std::min(instruction.optional_steps, value)};
+	int extra_steps{value - optional_steps};
 
-			break;
-		case "disjunction"_:
-			for (const auto & node : expression.nodes) {
-				_assign_search_encounter(state, encounter_id, *node);
-			}
+	if (extra_steps % 2 == 1 && optional_steps > 0) {
+		extra_steps++;
+		optional_steps--;
+	}
 
-			break;
-		case "number"_: {
-			auto number = expression.token_to_number<std::size_t>();
+	if (extra_steps % 2 == 1 && !instruction.can_single_step) {
+		extra_steps--;
+	}
 
-			if (!state->search_values.at(number) && state->search_targets.at(number) == encounter_id) {
-				state->search_values.at(number) = true;
-				return true;
-			}
+	int tiles{instruction.can_double_step ? extra_steps : extra_steps * 2};
 
-			break;
-		}
-		case "sequence"_:
-			for (const auto & node: expression.nodes) {
-				if (!_check_search_complete(state, *node)) {
-					return _assign_search_encounter(state, encounter_id, *node);
-				}
-			}
-
-			break;
-		default:
-			std::cerr << "BUG: Unimplemented tag in _assign_search_encounter. Please report this." << std::endl;
-			break;
+	if (tiles % 2 == 1) {
+		tiles++;
 	}
 
-	return false;
+	return std::make_pair(tiles, optional_steps + extra_steps);
 }
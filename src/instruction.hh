@@ -4,6 +4,7 @@
 #include <istream>
 #include <memory>
 #include <set>
+#include <stdexcept>
 #include <vector>
 
 #include "peglib.h"
@@ -64,4 +65,9 @@ using Route = std::vector<Instruction>;
 
 auto read_route(std::istream & input) -> Route;
 
+class RouteError : public std::runtime_error {
+	public:
+		using std::runtime_error::runtime_error;
+};
+
 #endif // ROSA_INSTRUCTION_HH
@@ -4,25 +4,50 @@
 #include <string>
 
 constexpr int CACHE_DEFAULT_SIZE = 1048576;
+constexpr int CACHE_DEFAULT_MAP_SIZE = 128;
+constexpr int CACHE_DEFAULT_SHARED_SIZE = 4096;
+constexpr int CHECKPOINT_DEFAULT_INTERVAL = 30;
 
 class Options {
 	public:
 		std::string route{"paladin"};
+		std::string seeds{"0"};
 
 		std::string variables{""};
+		std::string incumbent{""};
+		std::string evaluate{""};
+
+		std::string engine{"recursive"};
+		std::string format{"text"};
 
 		std::string cache_type{"dynamic"};
 		std::string cache_location{""};
 		std::string cache_filename{""};
+		std::string checkpoint{""};
+		std::string output_directory{""};
 
 		std::size_t cache_size{CACHE_DEFAULT_SIZE};
+		std::size_t cache_map_size{CACHE_DEFAULT_MAP_SIZE};
+		std::size_t shared_cache_size{CACHE_DEFAULT_SHARED_SIZE};
+		std::size_t memory_limit{0};
 
 		bool tas_mode{false};
 		bool prefer_fewer_locations{false};
+		bool count_states{false};
+		bool prune{false};
+		bool decision_cache{false};
+		bool suffix_keys{false};
+		bool cache_strip{false};
+		bool cache_compact{false};
+		bool resume{false};
+		bool verbose{false};
 
-		int seed{0};
 		int maximum_steps{0};
 		int maximum_step_segments{-1};
+
+		int threads{1};
+		int jobs{1};
+		int checkpoint_interval{CHECKPOINT_DEFAULT_INTERVAL};
 };
 
 #endif
@@ -6,9 +6,26 @@
 #include "instruction.hh"
 #include "variable.hh"
 
+#include <chrono>
 #include <memory>
+#include <string>
 #include <unordered_map>
 
+enum class EngineType {
+	Recursive,
+	Frontier
+};
+
+enum class OutputFormat {
+	Text,
+	Json,
+	Ndjson
+};
+
+/*
+ * Everything an engine needs for a run. The route data is fixed when the
+ * parameters are created, and the rest is set by name afterward.
+ */
 struct Parameters {
 	public:
 		const Route route;
@@ -16,16 +33,32 @@ struct Parameters {
 		const Encounters encounters;
 		const Maps maps;
 
-		const int maximum_extra_steps{256};
-		const bool tas_mode{false};
-		const bool prefer_fewer_locations{false};
-		const bool always_allow_cache{true};
+		int maximum_extra_steps{256};
+		bool tas_mode{false};
+		bool prefer_fewer_locations{false};
 
-		const int maximum_step_segments{-1};
+		int maximum_step_segments{-1};
 
 		CacheType cache_type = CacheType::Dynamic;
-		std::string cache_location;
-		const std::size_t cache_size{4294967295};
+		std::string cache_location{};
+		std::size_t cache_size{4294967295};
+
+		int threads{1};
+		EngineType engine_type{EngineType::Recursive};
+		bool prune{false};
+		bool decision_cache{false};
+		bool suffix_keys{false};
+		std::size_t memory_limit{0};
+		std::size_t cache_map_size{137438953472};
+		std::size_t shared_cache_size{4294967296};
+		CacheMetadata cache_metadata{};
+
+		std::string checkpoint_filename{};
+		std::chrono::seconds checkpoint_interval{1800};
+		bool resume{false};
+
+		OutputFormat output_format{OutputFormat::Text};
+		bool verbose{false};
 };
 
 #endif // ROSA_PARAMETERS_HH
@@ -62,3 +62,30 @@ auto operator<<(std::ostream & os, const Party & party) -> std::ostream & {
 	os << party._party;
 	return os;
 }
+
+Parties::Parties() {
+	add_party("");
+}
+
+auto Parties::add_party(const std::string & party) -> uint16_t {
+	auto result{_ids.find(party)};
+
+	if (result != _ids.end()) {
+		return result->second;
+	}
+
+	auto id{static_cast<uint16_t>(_parties.size())};
+
+	_parties.emplace_back(party);
+	_ids.emplace(party, id);
+
+	return id;
+}
+
+auto Parties::get_party(uint16_t id) const -> const Party & {
+	return _parties[id];
+}
+
+auto Parties::get_size() const -> std::size_t {
+	return _parties.size();
+}
@@ -3,6 +3,7 @@
 
 #include <cstdint>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 const int HASH_MULTIPLIER = 31;
@@ -34,6 +35,24 @@ class Party {
 		std::vector<std::tuple<int, int>> _characters;
 };
 
+/*
+ * Interns the parties used by a route, so that states can refer to a party by
+ * a small ID. The empty party is always assigned ID zero.
+ */
+class Parties {
+	public:
+		Parties();
+
+		auto add_party(const std::string & party) -> uint16_t;
+
+		[[nodiscard]] auto get_party(uint16_t id) const -> const Party &;
+		[[nodiscard]] auto get_size() const -> std::size_t;
+
+	private:
+		std::vector<Party> _parties;
+		std::unordered_map<std::string, uint16_t> _ids;
+};
+
 namespace std {
 	template <>
 	struct hash<Party> {
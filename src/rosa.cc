@@ -1,7 +1,19 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstdlib>
+#include <filesystem>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <tuple>
+#include <unordered_map>
+
+#include <sys/resource.h>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/algorithm/string/split.hpp>
@@ -9,14 +21,120 @@
 
 #include "CLI/CLI.hpp"
 
+#include "cache.hh"
+#include "cache_metadata.hh"
 #include "encounter.hh"
 #include "engine.hh"
 #include "instruction.hh"
 #include "map.hh"
 #include "options.hh"
 #include "parameters.hh"
+#include "thread_pool.hh"
 #include "version.hh"
 
+constexpr double BYTES_PER_MEBIBYTE = 1024.0 * 1024.0;
+
+/*
+ * Cache Command
+ */
+
+auto open_cache(CacheType cache_type, const std::string & cache_location, const Options & options) -> std::unique_ptr<DiskCache> {
+	if (cache_type == CacheType::Persistent) {
+		return std::make_unique<PersistentCache>(cache_location, std::nullopt, options.cache_size, 0, options.cache_map_size * 1024 * 1024 * 1024); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+	}
+
+	return std::make_unique<MappedCache>(cache_location, std::nullopt);
+}
+
+auto run_cache_command(CacheType cache_type, const std::string & cache_location, const CacheMetadata & metadata, const Options & options) -> int {
+	if (cache_type == CacheType::Dynamic) {
+		std::cerr << "ERROR: The cache command requires a persistent or mapped cache type\n";
+		return EXIT_FAILURE;
+	}
+
+	try {
+		auto cache{open_cache(cache_type, cache_location, options)};
+		auto stored{cache->get_metadata()};
+
+		std::cout << boost::format("%-21s%s\n") % "Location:" % cache_location;
+		std::cout << boost::format("%-21s%d\n") % "Entries:" % cache->get_stored_size();
+		std::cout << boost::format("%-21s%0.1f MiB\n") % "Size:" % (static_cast<double>(cache->get_disk_usage()) / BYTES_PER_MEBIBYTE);
+
+		if (stored) {
+			auto differences{stored->get_differences(metadata)};
+
+			std::cout << boost::format("%-21s%s\n") % "Rosa Version:" % stored->get_version();
+			std::cout << boost::format("%-21s%d\n") % "Maximum Extra Steps:" % stored->maximum_extra_steps;
+			std::cout << boost::format("%-21s%d\n") % "TAS Mode:" % stored->tas_mode;
+			std::cout << boost::format("%-21s%d\n") % "Suffix Keys:" % (stored->route_hash == 0 ? 1 : 0);
+			std::cout << boost::format("%-21s%s\n") % "Status:" % (differences.empty() ? "Reusable" : "Stale: " + boost::algorithm::join(differences, ", "));
+		} else {
+			std::cout << boost::format("%-21s%s\n") % "Status:" % "Unknown (no metadata)";
+		}
+
+		if (options.cache_strip && metadata.instructions == 0) {
+			std::cerr << "WARNING: A cache with suffix keys cannot be stripped, as its states are not stored by index\n";
+		} else if (options.cache_strip) {
+			std::cout << boost::format("%-21s%d entries\n") % "Stripped:" % cache->strip(metadata.instructions);
+		}
+
+		cache.reset();
+
+		if (options.cache_compact) {
+			if (cache_type == CacheType::Persistent) {
+				PersistentCache::compact(cache_location);
+			} else {
+				MappedCache::compact(cache_location);
+			}
+
+			cache = open_cache(cache_type, cache_location, options);
+			std::cout << boost::format("%-21s%0.1f MiB\n") % "Compacted Size:" % (static_cast<double>(cache->get_disk_usage()) / BYTES_PER_MEBIBYTE);
+		}
+	} catch (const CacheError & e) {
+		std::cerr << "ERROR: " << e.what() << '\n';
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/*
+ * Batch Mode
+ */
+
+// Returns the peak resident memory of the whole process in MiB, which Linux
+// reports in KiB.
+auto get_peak_memory() -> double {
+	rusage usage{};
+	getrusage(RUSAGE_SELF, &usage);
+
+	return static_cast<double>(usage.ru_maxrss) / 1024.0; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+}
+
+/*
+ * Variables
+ */
+
+// Reads variable values in the form of the VARS line of an output file, with
+// or without the leading VARS, such as "000001A:3 000002B:1".
+auto read_variables(const std::string & text) -> std::unordered_map<int, int> {
+	std::vector<std::string> tokens;
+	boost::algorithm::split(tokens, boost::algorithm::trim_copy(text), boost::is_any_of("\t "), boost::token_compress_on);
+
+	std::unordered_map<int, int> variables;
+
+	for (const auto & token : tokens) {
+		std::vector<std::string> values;
+		boost::algorithm::split(values, token, boost::is_any_of(":"));
+
+		if (values.size() == 2) {
+			variables[std::stoi(values[0], nullptr, 16)] = std::stoi(values[1]); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+		}
+	}
+
+	return variables;
+}
+
 /*
  * Main Function
  */
@@ -37,7 +155,7 @@ auto main (int argc, char ** argv) -> int {
 	CLI::App app{std::string{"Rosa "} + std::string{ROSA_VERSION}};
 
 	app.add_option("-r,--route", options.route, "Route to process", true);
-	app.add_option("-s,--seed", options.seed, "Seed to process", true);
+	app.add_option("-s,--seed", options.seeds, "Seed to process, or a range of seeds in the form first-last", true);
 	app.add_option("-m,--maximum-steps", options.maximum_steps, "Maximum number of extra steps per segment", true);
 	app.add_option("-n,--maximum-step-segments", options.maximum_step_segments, "Maximum number of segments where extra steps can be taken", false);
 	app.add_option("-v,--variables", options.variables, "Explicitly set variable constraints in the form variable:value[-max_value]", false);
@@ -45,10 +163,34 @@ auto main (int argc, char ** argv) -> int {
 	app.add_flag("-t,--tas-mode", options.tas_mode, "Use options appropriate for TAS Routing");
 	app.add_flag("-p,--prefer-fewer-locations", options.prefer_fewer_locations, "Prefer fewer locations with extra steps when maximum step segments is set.");
 
-	app.add_set("-c,--cache-type", options.cache_type, {"dynamic", "persistent"}, "The type of cache to use", true);
-	app.add_option("-l,--cache-location", options.cache_location, "The location for the cache if using a persistent cache");
-	app.add_option("-f,--cache-filename", options.cache_filename, "The filename for the cache if using a persistent cache");
+	app.add_option("--threads", options.threads, "Number of threads to use while optimizing", true);
+	auto * jobs_option{app.add_option("-j,--jobs", options.jobs, "Number of seeds to optimize at once when given a range of seeds", true)};
+	app.add_option("-o,--output-dir", options.output_directory, "A directory to write the route for each seed to, as NNN.txt, instead of standard output");
+	app.add_set("-e,--engine", options.engine, {"recursive", "frontier"}, "The optimization engine to use", true);
+	app.add_set("--format", options.format, {"text", "json", "ndjson"}, "The format of the generated route", true);
+	app.add_flag("--verbose", options.verbose, "Report the cache statistics for each seed once it is optimized");
+	app.add_flag("--count-states", options.count_states, "Count the reachable states at each route index instead of optimizing");
+	app.add_flag("-b,--prune", options.prune, "Skip candidates that cannot improve on the best known route");
+	app.add_option("-i,--incumbent", options.incumbent, "A previous output file whose route is used as the initial bound when pruning");
+	auto * evaluate_option{app.add_option("--evaluate", options.evaluate, "Report the time taken by the route with the given variables, in the form of the VARS line of an output file, instead of optimizing")};
+
+	auto * cache_type_option{app.add_set("-c,--cache-type", options.cache_type, {"dynamic", "persistent", "mapped", "shared"}, "The type of cache to use", true)};
+	auto * cache_location_option{app.add_option("-l,--cache-location", options.cache_location, "The location for the cache if using a persistent or mapped cache")};
+	auto * cache_filename_option{app.add_option("-f,--cache-filename", options.cache_filename, "The filename for the cache if using a persistent or mapped cache")};
 	app.add_option("-x,--cache-size", options.cache_size, "The size of the temporary in-memory cache if using a persistent cache");
+	app.add_option("--cache-map-size", options.cache_map_size, "The maximum size of the persistent cache database in GiB", true);
+	app.add_option("--shared-cache-size", options.shared_cache_size, "The size of the shared cache file in MiB", true);
+	app.add_flag("-d,--decision-cache", options.decision_cache, "Only cache states at instructions with a variable or where routes rejoin");
+	app.add_flag("--suffix-keys", options.suffix_keys, "Identify cached states by the remaining route, so that routes ending alike share them");
+	auto * memory_limit_option{app.add_option("--memory-limit", options.memory_limit, "The maximum size of the in-memory cache in MiB, evicting states once it is reached")};
+	app.add_option("--checkpoint", options.checkpoint, "A file to periodically save the dynamic cache to, so that the run can be resumed");
+	app.add_option("--checkpoint-interval", options.checkpoint_interval, "The number of minutes between checkpoints", true);
+	app.add_flag("--resume", options.resume, "Load the checkpoint file, if it exists, before optimizing");
+
+	auto * cache_command{app.add_subcommand("cache", "Report on a persistent or mapped cache instead of optimizing")};
+	cache_command->fallthrough();
+	cache_command->add_flag("--strip", options.cache_strip, "Remove states at indices beyond the end of the route");
+	cache_command->add_flag("--compact", options.cache_compact, "Rewrite the cache at the smallest size that holds its states");
 
 	try {
 		app.parse(argc, argv);
@@ -56,6 +198,24 @@ auto main (int argc, char ** argv) -> int {
 		return app.exit(e);
 	}
 
+	int first_seed{0};
+	int last_seed{0};
+
+	try {
+		std::vector<std::string> seeds;
+		boost::algorithm::split(seeds, options.seeds, boost::is_any_of("-"));
+
+		first_seed = std::stoi(seeds[0]);
+		last_seed = seeds.size() > 1 ? std::stoi(seeds[1]) : first_seed;
+
+		if (seeds.size() > 2 || last_seed < first_seed) {
+			throw std::invalid_argument{options.seeds};
+		}
+	} catch (...) {
+		std::cerr << "ERROR: Invalid seed or seed range: " << options.seeds << '\n';
+		return EXIT_FAILURE;
+	}
+
 	/*
 	 * Base Data
 	 */
@@ -68,7 +228,11 @@ auto main (int argc, char ** argv) -> int {
 		return EXIT_FAILURE;
 	}
 
-	auto route{read_route(route_source_file)};
+	std::stringstream route_source;
+	route_source << route_source_file.rdbuf();
+
+	auto route_hash{CacheMetadata::hash(route_source.str())};
+	auto route{read_route(route_source)};
 
 	std::string data_key{"ff2us"};
 
@@ -86,7 +250,11 @@ auto main (int argc, char ** argv) -> int {
 		return EXIT_FAILURE;
 	}
 
-	Encounters encounters{encounters_file};
+	std::stringstream encounters_source;
+	encounters_source << encounters_file.rdbuf();
+
+	auto data_hash{CacheMetadata::hash(encounters_source.str())};
+	Encounters encounters{encounters_source};
 
 	std::string maps_filename{"data/maps/" + data_key + ".txt"};
 	std::ifstream maps_file{maps_filename, std::ios_base::in};
@@ -96,13 +264,17 @@ auto main (int argc, char ** argv) -> int {
 		return EXIT_FAILURE;
 	}
 
-	Maps maps{maps_file};
+	std::stringstream maps_source;
+	maps_source << maps_file.rdbuf();
+
+	data_hash = CacheMetadata::hash(maps_source.str(), data_hash);
+	Maps maps{maps_source};
 
 	auto cache_type{CacheType::Dynamic};
 	auto cache_location{options.cache_filename};
 
-	if (options.cache_type == "persistent") {
-		cache_type = CacheType::Persistent;
+	if (options.cache_type == "persistent" || options.cache_type == "mapped" || options.cache_type == "shared") {
+		cache_type = options.cache_type == "persistent" ? CacheType::Persistent : options.cache_type == "mapped" ? CacheType::Mapped : CacheType::Shared;
 
 		if (cache_location.empty()) {
 			if (options.cache_location.empty()) {
@@ -111,15 +283,37 @@ auto main (int argc, char ** argv) -> int {
 				cache_location = options.cache_location;
 			}
 
-			cache_location += (boost::format("/%s-%03d.mdb") % options.route % options.seed).str();
+			// Suffix keys are shared by every route using the same data.
+			auto extension{cache_type == CacheType::Persistent ? "mdb" : "map"};
+			auto name{options.suffix_keys ? data_key : options.route};
+
+			if (last_seed > first_seed) {
+				cache_location += (boost::format("/%s-%03d-%03d.%s") % name % first_seed % last_seed % extension).str();
+			} else {
+				cache_location += (boost::format("/%s-%03d.%s") % name % first_seed % extension).str();
+			}
 		}
 	}
 
+	// A cache with suffix keys is not tied to a route, which is recorded as a
+	// route hash and length of zero.
+	CacheMetadata cache_metadata{ROSA_VERSION, options.suffix_keys ? 0 : route_hash, data_hash, options.suffix_keys ? 0 : route.size(), options.maximum_steps, options.tas_mode};
+
+	if (*cache_command) {
+		return run_cache_command(cache_type, cache_location, cache_metadata, options);
+	}
+
+	auto engine_type{EngineType::Recursive};
+
+	if (options.engine == "frontier") {
+		engine_type = EngineType::Frontier;
+	}
+
 	/*
 	 * Optimization
 	 */
 
-	Engine engine{Parameters{route, encounters, maps, options.maximum_steps, options.tas_mode, options.prefer_fewer_locations, options.variables.empty(), options.maximum_step_segments, cache_type, cache_location, options.cache_size}};
+	std::vector<std::tuple<int, int, int>> constraints;
 
 	if (!options.variables.empty()) {
 		std::vector<std::string> variables;
@@ -141,15 +335,242 @@ auto main (int argc, char ** argv) -> int {
 					maximum = std::stoi(values[1]);
 				}
 
-				engine.set_variable_minimum(index, minimum);
-				engine.set_variable_maximum(index, maximum);
+				constraints.emplace_back(index, minimum, maximum);
 			}
 		} catch (...) {
 			std::cerr << "WARNING: Invalid variable data supplied\n";
 		}
 	}
 
-	std::cout << engine.optimize(options.seed);
+	std::optional<std::pair<std::unordered_map<int, int>, Milliframes>> incumbent;
 
-	return EXIT_SUCCESS;
+	if (!options.incumbent.empty()) {
+		std::ifstream incumbent_file{options.incumbent, std::ios_base::in};
+
+		if (!incumbent_file.is_open()) {
+			std::cerr << "ERROR: Failed to open " << options.incumbent << '\n';
+			return EXIT_FAILURE;
+		}
+
+		std::unordered_map<int, int> variables;
+		Milliframes frames{Milliframes::max()};
+		std::string line;
+
+		try {
+			while (std::getline(incumbent_file, line)) {
+				std::vector<std::string> tokens;
+				boost::algorithm::split(tokens, line, boost::is_any_of("\t "), boost::token_compress_on);
+
+				if (tokens[0] == "FRAMES" && tokens.size() == 2) {
+					frames = Milliframes{std::stoll(tokens[1])};
+				} else if (tokens[0] == "VARS") {
+					variables = read_variables(line);
+				}
+			}
+		} catch (...) {
+			std::cerr << "WARNING: Invalid data in incumbent file: " << line << '\n';
+		}
+
+		incumbent = std::make_pair(variables, frames);
+	}
+
+	auto output_format{OutputFormat::Text};
+
+	if (options.format == "json") {
+		output_format = OutputFormat::Json;
+	} else if (options.format == "ndjson") {
+		output_format = OutputFormat::Ndjson;
+	}
+
+	Parameters parameters{route, encounters, maps};
+	parameters.maximum_extra_steps = options.maximum_steps;
+	parameters.tas_mode = options.tas_mode;
+	parameters.prefer_fewer_locations = options.prefer_fewer_locations;
+	parameters.maximum_step_segments = options.maximum_step_segments;
+	parameters.cache_type = cache_type;
+	parameters.cache_location = cache_location;
+	parameters.cache_size = options.cache_size;
+	parameters.threads = options.threads;
+	parameters.engine_type = engine_type;
+	parameters.prune = options.prune;
+	parameters.decision_cache = options.decision_cache;
+	parameters.suffix_keys = options.suffix_keys;
+	parameters.memory_limit = options.memory_limit * 1024 * 1024; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+	parameters.cache_map_size = options.cache_map_size * 1024 * 1024 * 1024; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+	parameters.shared_cache_size = options.shared_cache_size * 1024 * 1024; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+	parameters.cache_metadata = cache_metadata;
+	parameters.checkpoint_filename = options.checkpoint;
+	parameters.checkpoint_interval = std::chrono::minutes{options.checkpoint_interval};
+	parameters.resume = options.resume;
+	parameters.output_format = output_format;
+	parameters.verbose = options.verbose;
+
+	if (evaluate_option->count() > 0) {
+		// An evaluation replays each seed directly, without a cache or jobs.
+		for (const auto & [option, name] : {std::make_pair(cache_type_option, "--cache-type"), std::make_pair(cache_location_option, "--cache-location"), std::make_pair(cache_filename_option, "--cache-filename"), std::make_pair(memory_limit_option, "--memory-limit"), std::make_pair(jobs_option, "--jobs")}) {
+			if (option->count() > 0) {
+				std::cerr << "ERROR: " << name << " cannot be used with --evaluate\n";
+				return EXIT_FAILURE;
+			}
+		}
+
+		std::unordered_map<int, int> variables;
+
+		try {
+			variables = read_variables(options.evaluate);
+		} catch (...) {
+			std::cerr << "ERROR: Invalid variables to evaluate: " << options.evaluate << '\n';
+			return EXIT_FAILURE;
+		}
+
+		std::unique_ptr<Engine> engine;
+
+		try {
+			// Without a cache, there is nothing to checkpoint either.
+			Parameters evaluate_parameters{parameters};
+			evaluate_parameters.cache_type = CacheType::Dynamic;
+			evaluate_parameters.cache_location = "";
+			evaluate_parameters.checkpoint_filename = "";
+			evaluate_parameters.resume = false;
+
+			engine = std::make_unique<Engine>(evaluate_parameters);
+		} catch (const RouteError & e) {
+			std::cerr << "ERROR: " << e.what() << '\n';
+			return EXIT_FAILURE;
+		}
+
+		auto error{engine->get_variable_error(variables)};
+
+		if (!error.empty()) {
+			std::cerr << "ERROR: " << error << '\n';
+			return EXIT_FAILURE;
+		}
+
+		std::cout << engine->evaluate(first_seed, last_seed, variables);
+
+		return EXIT_SUCCESS;
+	}
+
+	// Several JSON objects written one after another are not valid JSON.
+	if (output_format == OutputFormat::Json && !options.count_states && last_seed > first_seed && options.output_directory.empty()) {
+		std::cerr << "ERROR: --format json can only write a range of seeds with --output-dir... use --format ndjson for a single stream\n";
+		return EXIT_FAILURE;
+	}
+
+	// Each job solves its share of the seeds with its own engine, reusing its
+	// cache from one seed to the next.
+	auto jobs{std::clamp(options.jobs, 1, last_seed - first_seed + 1)};
+
+	if (jobs > 1 && (cache_type == CacheType::Persistent || cache_type == CacheType::Mapped)) {
+		std::cerr << "WARNING: Only the dynamic and shared caches support multiple jobs... using one job\n";
+		jobs = 1;
+	}
+
+	if (jobs > 1 && !options.checkpoint.empty()) {
+		std::cerr << "WARNING: Checkpoints are only supported with one job... using one job\n";
+		jobs = 1;
+	}
+
+	if (jobs > 1 && parameters.threads > 1) {
+		std::cerr << "WARNING: Each job uses a single thread... ignoring --threads\n";
+		parameters.threads = 1;
+	}
+
+	// Each job gets an equal share of the memory limit, so that their caches
+	// stay within it together.
+	parameters.memory_limit /= static_cast<std::size_t>(jobs);
+
+	std::vector<std::unique_ptr<Engine>> engines;
+
+	try {
+		for (int job = 0; job < jobs; job++) {
+			engines.push_back(std::make_unique<Engine>(parameters));
+
+			for (const auto & [index, minimum, maximum] : constraints) {
+				engines.back()->set_variable_minimum(index, minimum);
+				engines.back()->set_variable_maximum(index, maximum);
+			}
+
+			if (incumbent) {
+				engines.back()->set_incumbent(incumbent->first, incumbent->second);
+			}
+		}
+	} catch (const CacheError & e) {
+		std::cerr << "ERROR: " << e.what() << '\n';
+		return EXIT_FAILURE;
+	} catch (const RouteError & e) {
+		std::cerr << "ERROR: " << e.what() << '\n';
+		return EXIT_FAILURE;
+	}
+
+	if (!options.output_directory.empty()) {
+		std::filesystem::create_directories(options.output_directory);
+	}
+
+	// Without an output directory, routes are written in order of their seeds
+	// as soon as every earlier seed is done.
+	std::mutex output_mutex;
+	std::vector<std::string> outputs(static_cast<std::size_t>(last_seed - first_seed + 1));
+	std::size_t next_output{0};
+	std::atomic<int> next_seed{first_seed};
+	bool failed{false};
+
+	// Timings are reported for every seed of a batch, which is what the
+	// scripts read instead of timing each run themselves.
+	bool batch{last_seed > first_seed || !options.output_directory.empty()};
+
+	auto run_job{[&](std::size_t job) {
+		auto & engine{engines[job]};
+
+		for (auto seed{next_seed++}; seed <= last_seed; seed = next_seed++) {
+			auto start_time{std::chrono::steady_clock::now()};
+			auto output{options.count_states ? engine->count_states(seed) : engine->optimize(seed)};
+			auto elapsed{std::chrono::duration<double>{std::chrono::steady_clock::now() - start_time}.count()};
+			auto cache_memory{engine->get_cache_statistics().memory_usage};
+
+			std::lock_guard<std::mutex> lock{output_mutex};
+
+			if (!options.output_directory.empty()) {
+				auto filename{(boost::format("%s/%03d.%s") % options.output_directory % seed % (output_format == OutputFormat::Text ? "txt" : output_format == OutputFormat::Json ? "json" : "ndjson")).str()};
+				std::ofstream output_file{filename, std::ios_base::out};
+
+				if (!(output_file << output)) {
+					std::cerr << "ERROR: Failed to write " << filename << '\n';
+					failed = true;
+				}
+			} else {
+				outputs[static_cast<std::size_t>(seed - first_seed)] = std::move(output);
+
+				for (; next_output < outputs.size() && !outputs[next_output].empty(); next_output++) {
+					std::cout << outputs[next_output] << std::flush;
+					outputs[next_output] = std::string{};
+				}
+			}
+
+			if (batch) {
+				std::cerr << boost::format("Seed %d: %0.3fs, %0.1f MiB cache, %0.1f MiB peak memory\n") % seed % elapsed % (static_cast<double>(cache_memory) / BYTES_PER_MEBIBYTE) % get_peak_memory();
+			}
+		}
+	}};
+
+	auto start_time{std::chrono::steady_clock::now()};
+
+	if (jobs > 1) {
+		ThreadPool pool{static_cast<std::size_t>(jobs)};
+		TaskGroup group{pool};
+
+		for (std::size_t job = 0; job < engines.size(); job++) {
+			group.run([&run_job, job]() { run_job(job); });
+		}
+
+		group.wait();
+	} else {
+		run_job(0);
+	}
+
+	if (batch) {
+		std::cerr << boost::format("Seeds: %d seeds in %0.3fs with %d jobs, %0.1f MiB peak memory\n") % (last_seed - first_seed + 1) % std::chrono::duration<double>{std::chrono::steady_clock::now() - start_time}.count() % jobs % get_peak_memory();
+	}
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
 }
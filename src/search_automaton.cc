@@ -0,0 +1,173 @@
+#include "search_automaton.hh"
+#include "instruction.hh"
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <string>
+#include <unordered_map>
+
+SearchAutomaton::SearchAutomaton(const peg::Ast * expression, const std::vector<int> & targets) {
+	std::vector<std::size_t> encounter_ids;
+
+	for (const auto & target : targets) {
+		auto encounter_id{static_cast<std::size_t>(target)};
+
+		if (target >= 0 && std::find(encounter_ids.begin(), encounter_ids.end(), encounter_id) == encounter_ids.end()) {
+			encounter_ids.push_back(encounter_id);
+		}
+	}
+
+	_column_count = encounter_ids.size();
+
+	if (!encounter_ids.empty()) {
+		_columns.assign(*std::max_element(encounter_ids.begin(), encounter_ids.end()) + 1, NO_COLUMN);
+
+		for (std::size_t column = 0; column < _column_count; column++) {
+			_columns[encounter_ids[column]] = static_cast<uint8_t>(column);
+		}
+	}
+
+	// Enumerate every reachable set of found targets in breadth-first order,
+	// with one bit per target as in the original expression.
+	std::vector<uint64_t> values{0};
+	std::unordered_map<uint64_t, std::size_t> value_states{{0, 0}};
+	std::vector<std::size_t> transitions;
+	std::vector<uint8_t> complete;
+
+	for (std::size_t state = 0; state < values.size(); state++) {
+		bool state_complete{expression != nullptr && _check_complete(values[state], *expression)};
+		complete.push_back(state_complete ? 1 : 0);
+
+		for (const auto & encounter_id : encounter_ids) {
+			auto next_values{values[state]};
+
+			if (!state_complete && expression != nullptr) {
+				_assign(&next_values, encounter_id, *expression, targets);
+			}
+
+			auto next_state{value_states.find(next_values)};
+
+			if (next_state == value_states.end()) {
+				if (values.size() == MAXIMUM_SEARCH_STATES) {
+					throw RouteError{"A search expression may reach at most " + std::to_string(MAXIMUM_SEARCH_STATES) + " distinct states"};
+				}
+
+				next_state = value_states.emplace(next_values, values.size()).first;
+				values.push_back(next_values);
+			}
+
+			transitions.push_back(next_state->second);
+		}
+	}
+
+	// Merge states whose futures cannot be told apart by refining the
+	// partition on completion until every state in a class has successors in
+	// the same classes. Classes are numbered in order of their first state, so
+	// the start of the search remains state zero.
+	std::vector<std::size_t> classes{complete.begin(), complete.end()};
+	std::size_t class_count{0};
+
+	while (true) {
+		std::map<std::vector<std::size_t>, std::size_t> signatures;
+		std::vector<std::size_t> next_classes(values.size());
+
+		for (std::size_t state = 0; state < values.size(); state++) {
+			std::vector<std::size_t> signature{classes[state]};
+
+			for (std::size_t column = 0; column < _column_count; column++) {
+				signature.push_back(classes[transitions[state * _column_count + column]]);
+			}
+
+			next_classes[state] = signatures.emplace(signature, signatures.size()).first->second;
+		}
+
+		classes = std::move(next_classes);
+
+		if (signatures.size() == class_count) {
+			break;
+		}
+
+		class_count = signatures.size();
+	}
+
+	_transitions.resize(class_count * _column_count);
+	_complete.resize(class_count);
+
+	for (std::size_t state = 0; state < values.size(); state++) {
+		_complete[classes[state]] = complete[state];
+
+		for (std::size_t column = 0; column < _column_count; column++) {
+			_transitions[classes[state] * _column_count + column] = static_cast<uint16_t>(classes[transitions[state * _column_count + column]]);
+		}
+	}
+}
+
+auto SearchAutomaton::get_size() const -> std::size_t {
+	return _complete.size();
+}
+
+auto SearchAutomaton::_check_complete(uint64_t values, const peg::Ast & expression) -> bool {
+	using peg::udl::operator""_;
+
+	switch (expression.tag) {
+		case "disjunction"_:
+			return std::any_of(expression.nodes.begin(), expression.nodes.end(), [values](const auto & node){ return _check_complete(values, *node); });
+		case "conjunction"_:
+		case "sequence"_:
+			return std::all_of(expression.nodes.begin(), expression.nodes.end(), [values](const auto & node){ return _check_complete(values, *node); });
+		case "number"_:
+			return ((values >> expression.token_to_number<std::size_t>()) & 1U) != 0;
+		default:
+			std::cerr << "BUG: Unimplemented tag in _check_complete. Please report this." << std::endl;
+			break;
+	}
+
+	return false;
+}
+
+auto SearchAutomaton::_assign(uint64_t * values, std::size_t encounter_id, const peg::Ast & expression, const std::vector<int> & targets) -> bool {
+	using peg::udl::operator""_;
+
+	switch (expression.tag) {
+		case "conjunction"_:
+			for (const auto & node : expression.nodes) {
+				if (!_check_complete(*values, *node)) {
+					if (_assign(values, encounter_id, *node, targets)) {
+						return true;
+					}
+				}
+			}
+
+			break;
+		case "disjunction"_:
+			for (const auto & node : expression.nodes) {
+				_assign(values, encounter_id, *node, targets);
+			}
+
+			break;
+		case "number"_: {
+			auto number = expression.token_to_number<std::size_t>();
+
+			if (number < targets.size() && ((*values >> number) & 1U) == 0 && static_cast<std::size_t>(targets[number]) == encounter_id) {
+				*values |= 1ULL << number;
+				return true;
+			}
+
+			break;
+		}
+		case "sequence"_:
+			for (const auto & node: expression.nodes) {
+				if (!_check_complete(*values, *node)) {
+					return _assign(values, encounter_id, *node, targets);
+				}
+			}
+
+			break;
+		default:
+			std::cerr << "BUG: Unimplemented tag in _assign. Please report this." << std::endl;
+			break;
+	}
+
+	return false;
+}
@@ -0,0 +1,51 @@
+#ifndef ROSA_SEARCH_AUTOMATON_HH
+#define ROSA_SEARCH_AUTOMATON_HH
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "peglib.h"
+
+constexpr std::size_t MAXIMUM_SEARCH_TARGETS = 48;
+constexpr std::size_t MAXIMUM_SEARCH_STATES = std::numeric_limits<uint16_t>::max() + 1;
+
+/*
+ * A SEARCH expression compiled into a transition table. Each state stands for
+ * every set of found targets that behaves the same from then on, so states
+ * that differ only in progress that can no longer matter share an ID. State
+ * zero is the start of the search, and encounters that are not targets of the
+ * search never change the state.
+ */
+class SearchAutomaton {
+	public:
+		SearchAutomaton(const peg::Ast * expression, const std::vector<int> & targets);
+
+		[[nodiscard]] auto get_next_state(uint16_t state, std::size_t encounter_id) const -> uint16_t {
+			if (encounter_id >= _columns.size() || _columns[encounter_id] == NO_COLUMN) {
+				return state;
+			}
+
+			return _transitions[state * _column_count + _columns[encounter_id]];
+		}
+
+		[[nodiscard]] auto is_complete(uint16_t state) const -> bool {
+			return _complete[state] != 0;
+		}
+
+		[[nodiscard]] auto get_size() const -> std::size_t;
+
+	private:
+		static constexpr uint8_t NO_COLUMN = UINT8_MAX;
+
+		static auto _check_complete(uint64_t values, const peg::Ast & expression) -> bool;
+		static auto _assign(uint64_t * values, std::size_t encounter_id, const peg::Ast & expression, const std::vector<int> & targets) -> bool;
+
+		std::size_t _column_count{0};
+
+		std::vector<uint8_t> _columns;
+		std::vector<uint16_t> _transitions;
+		std::vector<uint8_t> _complete;
+};
+
+#endif // ROSA_SEARCH_AUTOMATON_HH
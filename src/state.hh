@@ -1,13 +1,23 @@
 #ifndef ROSA_STATE_HH
 #define ROSA_STATE_HH
 
-#include <array>
-
-#include "peglib.h"
-
-#include "map.hh"
-#include "party.hh"
-
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+/*
+ * A trivially copyable search state. Parties are stored as IDs into the
+ * engine's party table, and the active search is referenced by the index of
+ * its SEARCH instruction, with its progress as a state of that search's
+ * automaton.
+ *
+ * The location identifies where the state is for the cache, and is kept up to
+ * date by the engine. It normally holds the party, the index and the scope of
+ * the variable constraints from the index onward, in the same places as the
+ * keys. With suffix keys, it is instead a hash of the remaining route, so
+ * that routes ending in the same instructions share their states.
+ */
 struct State {
 	int step_seed{0}; // NOLINT(misc-non-private-member-variables-in-classes)
 	int step_index{0}; // NOLINT(misc-non-private-member-variables-in-classes)
@@ -21,21 +31,17 @@ struct State {
 
 	uint16_t remaining_segments{std::numeric_limits<uint16_t>::max()}; // NOLINT(misc-non-private-member-variables-in-classes)
 
-	Party party{""}; // NOLINT(misc-non-private-member-variables-in-classes)
-	Party search_party{""}; // NOLINT(misc-non-private-member-variables-in-classes)
+	uint16_t party{0}; // NOLINT(misc-non-private-member-variables-in-classes)
 
-	std::shared_ptr<peg::Ast> search_expression{}; // NOLINT(misc-non-private-member-variables-in-classes)
-	std::vector<std::size_t> search_targets{}; // NOLINT(misc-non-private-member-variables-in-classes)
-	std::array<bool, 48> search_values{false}; // NOLINT(misc-non-private-member-variables-in-classes,cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+	uint16_t search_index{0}; // NOLINT(misc-non-private-member-variables-in-classes)
+	uint16_t search_state{0}; // NOLINT(misc-non-private-member-variables-in-classes)
 	bool search_active{false}; // NOLINT(misc-non-private-member-variables-in-classes)
 	bool search_complete{false}; // NOLINT(misc-non-private-member-variables-in-classes)
 
-	[[nodiscard]] auto get_keys() const -> std::tuple<uint64_t, uint64_t, uint64_t> {
-		const auto [party_key1, party_key2] = party.get_keys();
+	uint64_t location{0}; // NOLINT(misc-non-private-member-variables-in-classes)
 
-		uint64_t key1{static_cast<uint64_t>(party_key1) << 48U}; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
-		uint64_t key2{static_cast<uint64_t>(0)};
-		uint64_t key3{static_cast<uint64_t>(party_key2)};
+	[[nodiscard]] auto get_keys() const -> std::pair<uint64_t, uint64_t> {
+		uint64_t key1{location >> 48U << 48U}; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
 
 		key1 += static_cast<uint64_t>(remaining_segments) << 32U; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
 		key1 += static_cast<uint64_t>(step_seed) << 24U; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
@@ -43,13 +49,9 @@ struct State {
 		key1 += static_cast<uint64_t>(encounter_seed) << 8U; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
 		key1 += static_cast<uint64_t>(encounter_index);
 
-		for (const auto & value : search_values) {
-			key2 = (key2 << 1U) + static_cast<uint64_t>(value ? 1 : 0);
-		}
+		uint64_t key2{search_state + (location << 16U)}; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
 
-		key2 += static_cast<uint64_t>(index) << 48U; // NOLINT: readability-magic-numbers
-
-		return std::make_tuple(key1, key2, key3);
+		return std::make_pair(key1, key2);
 	}
 
 	auto operator==(const State & other) const -> bool {
@@ -57,4 +59,9 @@ struct State {
 	}
 };
 
+constexpr std::size_t CACHE_LINE_SIZE = 64;
+
+static_assert(std::is_trivially_copyable_v<State>);
+static_assert(sizeof(State) <= CACHE_LINE_SIZE);
+
 #endif // ROSA_STATE_HH
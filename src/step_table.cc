@@ -0,0 +1,108 @@
+#include "step_table.hh"
+
+#include "rng.hh"
+
+#include <iostream>
+
+// The multiplicative inverse of SEED_UPDATE_DELTA modulo 256.
+constexpr int SEED_UPDATE_INVERSE = 241;
+
+static_assert((SEED_UPDATE_DELTA * SEED_UPDATE_INVERSE) % (UINT8_MAX + 1) == 1);
+
+StepTable::StepTable(int encounter_rate) : _distances(STEP_CYCLE_LENGTH), _counts(STEP_CYCLE_LENGTH + 1) {
+	std::vector<bool> encounters(STEP_CYCLE_LENGTH);
+
+	for (int position = 0; position < STEP_CYCLE_LENGTH; position++) {
+		auto value{(RNG_DATA[static_cast<std::size_t>(get_step_index(position))] + get_step_seed(position)) % (UINT8_MAX + 1)};
+
+		encounters[static_cast<std::size_t>(position)] = value < encounter_rate;
+		_counts[static_cast<std::size_t>(position) + 1] = _counts[static_cast<std::size_t>(position)] + (value < encounter_rate ? 1 : 0);
+	}
+
+	_has_encounters = _counts[STEP_CYCLE_LENGTH] > 0;
+
+	if (!_has_encounters) {
+		return;
+	}
+
+	// Two passes backward over the cycle ensure that the distances at the end
+	// of the cycle wrap around to the first encounter at its beginning.
+	int distance{STEP_CYCLE_LENGTH};
+
+	for (int i = 2 * STEP_CYCLE_LENGTH - 1; i >= 0; i--) {
+		auto position{static_cast<std::size_t>(i % STEP_CYCLE_LENGTH)};
+
+		distance++;
+
+		if (i < STEP_CYCLE_LENGTH) {
+			_distances[position] = static_cast<uint16_t>(distance);
+		}
+
+		if (encounters[position]) {
+			distance = 0;
+		}
+	}
+}
+
+auto StepTable::get_position(int step_seed, int step_index) -> int {
+	return ((step_seed * SEED_UPDATE_INVERSE) % (UINT8_MAX + 1)) * (UINT8_MAX + 1) + step_index;
+}
+
+auto StepTable::get_step_seed(int position) -> int {
+	return ((position / (UINT8_MAX + 1)) * SEED_UPDATE_DELTA) % (UINT8_MAX + 1);
+}
+
+auto StepTable::get_step_index(int position) -> int {
+	return position % (UINT8_MAX + 1);
+}
+
+/*
+ * Returns the number of steps from the given position to the next encounter,
+ * which is always at least one.
+ */
+auto StepTable::get_distance(int position) const -> int {
+	if (!_has_encounters) {
+		return std::numeric_limits<int>::max();
+	}
+
+	return _distances[static_cast<std::size_t>(position)];
+}
+
+/*
+ * Returns the number of encounters in the given number of steps taken from the
+ * given position.
+ */
+auto StepTable::count_encounters(int position, int steps) const -> int {
+	auto cycles{steps / STEP_CYCLE_LENGTH};
+	auto start{static_cast<std::size_t>(position) + 1};
+	auto end{start + static_cast<std::size_t>(steps % STEP_CYCLE_LENGTH)};
+	auto count{static_cast<int>(_counts[STEP_CYCLE_LENGTH]) * cycles};
+
+	if (end <= STEP_CYCLE_LENGTH) {
+		count += static_cast<int>(_counts[end] - _counts[start]);
+	} else {
+		count += static_cast<int>(_counts[STEP_CYCLE_LENGTH] - _counts[start] + _counts[end - STEP_CYCLE_LENGTH]);
+	}
+
+	return count;
+}
+
+auto StepTables::get(int encounter_rate) const -> const StepTable & {
+	if (encounter_rate < 0 || encounter_rate > UINT8_MAX || !_tables[static_cast<std::size_t>(encounter_rate)]) {
+		std::cerr << "BUG: Attempted to use a step table that was not built for encounter rate " << encounter_rate << '\n';
+		return *_empty_table;
+	}
+
+	return *_tables[static_cast<std::size_t>(encounter_rate)];
+}
+
+void StepTables::add(int encounter_rate) {
+	if (encounter_rate < 0 || encounter_rate > UINT8_MAX) {
+		std::cerr << "WARNING: Ignoring invalid encounter rate " << encounter_rate << '\n';
+		return;
+	}
+
+	if (!_tables[static_cast<std::size_t>(encounter_rate)]) {
+		_tables[static_cast<std::size_t>(encounter_rate)] = std::make_unique<const StepTable>(encounter_rate);
+	}
+}
@@ -0,0 +1,46 @@
+#ifndef ROSA_STEP_TABLE_HH
+#define ROSA_STEP_TABLE_HH
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+constexpr int STEP_CYCLE_LENGTH = (UINT8_MAX + 1) * (UINT8_MAX + 1);
+
+/*
+ * As SEED_UPDATE_DELTA is odd, the step seed visits every value before
+ * repeating, so the (step_seed, step_index) pair walks a single cycle of 65536
+ * positions regardless of the starting seed. A StepTable records, for one
+ * encounter rate, where the encounters fall on that cycle.
+ */
+class StepTable {
+	public:
+		explicit StepTable(int encounter_rate);
+
+		static auto get_position(int step_seed, int step_index) -> int;
+		static auto get_step_seed(int position) -> int;
+		static auto get_step_index(int position) -> int;
+
+		[[nodiscard]] auto get_distance(int position) const -> int;
+		[[nodiscard]] auto count_encounters(int position, int steps) const -> int;
+
+	private:
+		bool _has_encounters{false};
+
+		std::vector<uint16_t> _distances;
+		std::vector<uint32_t> _counts;
+};
+
+class StepTables {
+	public:
+		[[nodiscard]] auto get(int encounter_rate) const -> const StepTable &;
+
+		void add(int encounter_rate);
+
+	private:
+		std::vector<std::unique_ptr<const StepTable>> _tables{UINT8_MAX + 1};
+		std::unique_ptr<const StepTable> _empty_table{std::make_unique<const StepTable>(0)};
+};
+
+#endif // ROSA_STEP_TABLE_HH
@@ -0,0 +1,169 @@
+#include "thread_pool.hh"
+
+#include <algorithm>
+#include <chrono>
+
+using namespace std::chrono_literals;
+
+constexpr int MAXIMUM_STEAL_NESTING = 8;
+
+thread_local const ThreadPool * current_pool{nullptr}; // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+thread_local std::size_t current_worker{0}; // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+thread_local int current_nesting{0}; // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+ThreadPool::ThreadPool(std::size_t size) {
+	if (size == 0) {
+		size = 1;
+	}
+
+	for (std::size_t i = 0; i < size; i++) {
+		_workers.push_back(std::make_unique<Worker>());
+	}
+
+	current_pool = this;
+	current_worker = 0;
+
+	for (std::size_t i = 1; i < size; i++) {
+		_threads.emplace_back([this, i]() { _run(i); });
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	_stopping = true;
+	_idle_condition.notify_all();
+
+	for (auto & thread : _threads) {
+		thread.join();
+	}
+
+	if (current_pool == this) {
+		current_pool = nullptr;
+	}
+}
+
+auto ThreadPool::get_size() const -> std::size_t {
+	return _workers.size();
+}
+
+auto ThreadPool::is_saturated() const -> bool {
+	return _queued.load(std::memory_order_relaxed) >= _workers.size();
+}
+
+void ThreadPool::_push(Task task) {
+	auto & worker{*_workers[_get_worker_index()]};
+
+	{
+		std::lock_guard<std::mutex> lock{worker.mutex};
+		worker.tasks.push_back(std::move(task));
+	}
+
+	_queued++;
+	_idle_condition.notify_one();
+}
+
+auto ThreadPool::_pop(const TaskGroup * group, Task * task) -> bool {
+	auto & worker{*_workers[_get_worker_index()]};
+	std::lock_guard<std::mutex> lock{worker.mutex};
+
+	if (worker.tasks.empty() || (group != nullptr && worker.tasks.back().group != group)) {
+		return false;
+	}
+
+	*task = std::move(worker.tasks.back());
+	worker.tasks.pop_back();
+	_queued--;
+
+	return true;
+}
+
+auto ThreadPool::_steal(Task * task) -> bool {
+	auto index{_get_worker_index()};
+
+	for (std::size_t i = 1; i < _workers.size(); i++) {
+		auto & worker{*_workers[(index + i) % _workers.size()]};
+		std::lock_guard<std::mutex> lock{worker.mutex};
+
+		if (!worker.tasks.empty()) {
+			*task = std::move(worker.tasks.front());
+			worker.tasks.pop_front();
+			_queued--;
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void ThreadPool::_execute(Task * task) {
+	current_nesting++;
+	task->function();
+	current_nesting--;
+
+	task->group->_pending.fetch_sub(1, std::memory_order_release);
+}
+
+void ThreadPool::_run(std::size_t index) {
+	current_pool = this;
+	current_worker = index;
+
+	while (!_stopping) {
+		Task task;
+
+		if (_pop(nullptr, &task) || _steal(&task)) {
+			_execute(&task);
+		} else {
+			std::unique_lock<std::mutex> lock{_idle_mutex};
+			_idle_condition.wait_for(lock, 1ms, [this]() { return _queued > 0 || _stopping; });
+		}
+	}
+}
+
+auto ThreadPool::_get_worker_index() const -> std::size_t {
+	return current_pool == this ? current_worker : 0;
+}
+
+TaskGroup::TaskGroup(ThreadPool & pool) : _pool{pool} { }
+
+TaskGroup::~TaskGroup() {
+	wait();
+}
+
+void TaskGroup::run(std::function<void()> function) {
+	_pending.fetch_add(1, std::memory_order_relaxed);
+	_pool._push(ThreadPool::Task{this, std::move(function)});
+}
+
+void TaskGroup::wait() {
+	while (_pending.load(std::memory_order_acquire) > 0) {
+		ThreadPool::Task task;
+
+		if (_pool._pop(this, &task) || (current_nesting < MAXIMUM_STEAL_NESTING && _pool._steal(&task))) {
+			_pool._execute(&task);
+		} else {
+			std::this_thread::yield();
+		}
+	}
+}
+
+void parallel_for(ThreadPool * pool, std::size_t count, std::size_t batch_size, const std::function<void(std::size_t, std::size_t)> & function) {
+	batch_size = std::max(batch_size, static_cast<std::size_t>(1));
+
+	if (pool == nullptr || count <= batch_size) {
+		if (count > 0) {
+			function(0, count);
+		}
+
+		return;
+	}
+
+	TaskGroup group{*pool};
+
+	for (std::size_t begin = 0; begin < count; begin += batch_size) {
+		group.run([&function, begin, count, batch_size]() {
+			function(begin, std::min(begin + batch_size, count));
+		});
+	}
+
+	group.wait();
+}
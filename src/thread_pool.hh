@@ -0,0 +1,98 @@
+#ifndef ROSA_THREAD_POOL_HH
+#define ROSA_THREAD_POOL_HH
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class TaskGroup;
+
+/*
+ * A small work-stealing pool. Each worker owns a deque: it pushes and pops its
+ * own tasks at the back, while idle workers steal from the front, which is
+ * where the oldest (and therefore largest) subtrees of the search live. The
+ * thread that constructs the pool is treated as worker zero, so it is expected
+ * to be the thread that later submits and waits on work.
+ */
+class ThreadPool {
+	public:
+		explicit ThreadPool(std::size_t size);
+		ThreadPool(const ThreadPool &) = delete;
+		ThreadPool(const ThreadPool &&) = delete;
+		auto operator=(const ThreadPool &) -> ThreadPool & = delete;
+		auto operator=(const ThreadPool &&) -> ThreadPool & = delete;
+
+		~ThreadPool();
+
+		[[nodiscard]] auto get_size() const -> std::size_t;
+		[[nodiscard]] auto is_saturated() const -> bool;
+
+	private:
+		friend class TaskGroup;
+
+		struct Task {
+			TaskGroup * group{nullptr};
+			std::function<void()> function{};
+		};
+
+		struct Worker {
+			std::mutex mutex{};
+			std::deque<Task> tasks{};
+		};
+
+		void _push(Task task);
+		auto _pop(const TaskGroup * group, Task * task) -> bool;
+		auto _steal(Task * task) -> bool;
+		void _execute(Task * task);
+		void _run(std::size_t index);
+
+		[[nodiscard]] auto _get_worker_index() const -> std::size_t;
+
+		std::vector<std::unique_ptr<Worker>> _workers;
+		std::vector<std::thread> _threads;
+
+		std::atomic<std::size_t> _queued{0};
+		std::atomic<bool> _stopping{false};
+
+		std::mutex _idle_mutex;
+		std::condition_variable _idle_condition;
+};
+
+/*
+ * A set of tasks that can be waited on together. While waiting, the calling
+ * thread runs its own queued tasks and, up to a limited nesting depth, steals
+ * work from other threads instead of sitting idle.
+ */
+class TaskGroup {
+	public:
+		explicit TaskGroup(ThreadPool & pool);
+		TaskGroup(const TaskGroup &) = delete;
+		TaskGroup(const TaskGroup &&) = delete;
+		auto operator=(const TaskGroup &) -> TaskGroup & = delete;
+		auto operator=(const TaskGroup &&) -> TaskGroup & = delete;
+
+		~TaskGroup();
+
+		void run(std::function<void()> function);
+		void wait();
+
+	private:
+		friend class ThreadPool;
+
+		ThreadPool & _pool;
+
+		std::atomic<std::size_t> _pending{0};
+};
+
+/*
+ * Calls function(begin, end) over consecutive batches of [0, count). The
+ * batches run as tasks on the pool if one is given, or serially otherwise.
+ */
+void parallel_for(ThreadPool * pool, std::size_t count, std::size_t batch_size, const std::function<void(std::size_t, std::size_t)> & function);
+
+#endif // ROSA_THREAD_POOL_HH